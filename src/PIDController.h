@@ -0,0 +1,125 @@
+#ifndef PIDCONTROLLER_H_
+#define PIDCONTROLLER_H_
+
+#include <math.h>
+
+
+/*
+    PID controller with the time step in seconds and an output limited to [min, max].
+
+    - The integral accumulates error * dt and stops growing while the output is saturated in the
+      direction of the error (conditional integration), so it does not wind up against the speed limits.
+    - The derivative is taken on the measurement rather than the error and passed through a first order
+      low pass filter, so the scale noise and setpoint steps do not kick the output.
+    - A sample with dt <= 0 (frames decoded back to back) only refreshes the proportional term.
+    - A non-finite input (a frame that does not decode) returns the previous output and leaves the
+      state untouched, a nan in the integral or the derivative would hold the output at a limit.
+
+    Gains: kp in output per unit error, ki in output per unit error * s, kd in output per unit error / s.
+*/
+class PIDController
+{
+private:
+    float kp;
+    float ki;
+    float kd;
+    float derivative_filter_time_s;
+
+    float output_min;
+    float output_max;
+
+    float integral;
+    float filtered_derivative;
+    float last_measurement;
+    bool has_last_measurement;
+
+    float output;
+    bool saturated;
+
+public:
+    PIDController() :
+        kp(0.0f), ki(0.0f), kd(0.0f), derivative_filter_time_s(0.0f),
+        output_min(-INFINITY), output_max(INFINITY) {
+        reset();
+    }
+
+    void setGains(float kp, float ki, float kd) {
+        this->kp = kp;
+        this->ki = ki;
+        this->kd = kd;
+    }
+
+    void setOutputLimits(float min, float max) {
+        output_min = min;
+        output_max = max;
+    }
+
+    // Time constant of the derivative filter, 0 disables the filter
+    void setDerivativeFilter(float time_constant_s) {
+        derivative_filter_time_s = fmaxf(0.0f, time_constant_s);
+    }
+
+    // Clear the controller state, the next update starts without derivative history
+    void reset() {
+        integral = 0.0f;
+        filtered_derivative = 0.0f;
+        last_measurement = 0.0f;
+        has_last_measurement = false;
+        output = 0.0f;
+        saturated = false;
+    }
+
+    // Calculate the output for a new measurement. The feed forward term is added before the output
+    // is limited, so the anti-windup accounts for it.
+    float update(float setpoint, float measurement, float dt_s, float feed_forward=0.0f) {
+        if (!isfinite(setpoint) || !isfinite(measurement) || !isfinite(dt_s) || !isfinite(feed_forward)) {
+            return output;
+        }
+
+        float error = setpoint - measurement;
+
+        if (dt_s > 0) {
+            if (has_last_measurement) {
+                float derivative = (measurement - last_measurement) / dt_s;
+
+                // Discrete first order filter, alpha = dt / (tf + dt) is stable for any dt
+                float alpha = dt_s / (derivative_filter_time_s + dt_s);
+                filtered_derivative += alpha * (derivative - filtered_derivative);
+            }
+
+            last_measurement = measurement;
+            has_last_measurement = true;
+        }
+        else if (!has_last_measurement) {
+            last_measurement = measurement;
+            has_last_measurement = true;
+        }
+
+        float d_term = -kd * filtered_derivative;
+
+        // Conditional integration: take the step only if it does not push a saturated output further
+        if (dt_s > 0 && ki != 0) {
+            float candidate_integral = integral + error * dt_s;
+            float candidate_output = feed_forward + kp * error + ki * candidate_integral + d_term;
+
+            bool push_above = candidate_output > output_max && ki * error > 0;
+            bool push_below = candidate_output < output_min && ki * error < 0;
+            if (!push_above && !push_below) {
+                integral = candidate_integral;
+            }
+        }
+
+        float unlimited_output = feed_forward + kp * error + ki * integral + d_term;
+        output = fmaxf(output_min, fminf(unlimited_output, output_max));
+        saturated = output != unlimited_output;
+
+        return output;
+    }
+
+    float getOutput() const { return output; }
+    float getIntegral() const { return integral; }
+    float getDerivative() const { return filtered_derivative; }
+    bool isSaturated() const { return saturated; }
+};
+
+#endif  // PIDCONTROLLER_H_
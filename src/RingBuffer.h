@@ -0,0 +1,270 @@
+#ifndef RINGBUFFER_H_
+#define RINGBUFFER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+
+// Recompute the running sums from the stored data after this many enqueues to bound the drift
+#define RING_BUFFER_RENORMALISE_INTERVAL    128
+
+
+// Value used by the StatisticRingBuffer statistics. Provide an overload next to the element type to support a new type.
+inline double ring_buffer_value(float value) {
+    return value;
+}
+
+inline double ring_buffer_value(int32_t value) {
+    return value;
+}
+
+
+/*
+    Fixed capacity ring buffer with inline storage. Once full, enqueue overwrites the oldest element.
+
+    Elements are indexed in chronological order: [0] is the oldest and [getCounter() - 1] is the newest.
+    Use StatisticRingBuffer for the running statistics.
+*/
+template <typename T, size_t N>
+class RingBuffer
+{
+    static_assert(N > 0, "RingBuffer capacity must be non-zero");
+
+private:
+    T data[N];
+
+    size_t read_ptr;
+    size_t write_ptr;
+    size_t count;
+
+    // overflow
+    bool is_over_flow;
+
+public:
+    class const_iterator {
+    private:
+        const RingBuffer * buffer;
+        size_t idx;
+
+    public:
+        const_iterator(const RingBuffer * buffer, size_t idx) : buffer(buffer), idx(idx) {}
+
+        const T & operator*() const { return (*buffer)[idx]; }
+        const_iterator & operator++() { idx++; return *this; }
+        bool operator!=(const const_iterator & other) const { return idx != other.idx; }
+    };
+
+    RingBuffer() {
+        reset();
+    }
+
+    // enqueue and dequeue
+    void enqueue(const T & in) {
+        if (count == N) {
+            read_ptr = (read_ptr + 1) % N;
+            count--;
+            is_over_flow = true;
+        }
+
+        data[write_ptr] = in;
+        write_ptr = (write_ptr + 1) % N;
+        count++;
+    }
+
+    T dequeue() {
+        T temp = data[read_ptr];
+
+        if (count > 0) {
+            read_ptr = (read_ptr + 1) % N;
+            count--;
+        }
+
+        return temp;
+    }
+
+    void reset() {
+        read_ptr = 0;
+        write_ptr = 0;
+        count = 0;
+
+        clearOverFlow();
+    }
+
+    size_t getCounter() const { return count; }
+    size_t getCapacity() const { return N; }
+    bool isFull() const { return count == N; }
+
+    // overflow
+    bool getOverFlow() const { return is_over_flow; }
+    void clearOverFlow() { is_over_flow = false; }
+
+    // Oldest and newest element, only valid if the buffer is not empty
+    const T & first() const { return data[read_ptr]; }
+    const T & last() const { return data[(write_ptr + N - 1) % N]; }
+
+    // Chronological access
+    const T & operator[](size_t idx) const { return data[(read_ptr + idx) % N]; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+};
+
+
+/*
+    RingBuffer with running statistics of ring_buffer_value() over the valid elements. The sum, mean, standard
+    deviation and slope are constant time to update and to read.
+
+    The sums are recomputed from the stored data every RING_BUFFER_RENORMALISE_INTERVAL enqueues to bound
+    the drift, and when a non-finite value leaves the buffer: a NaN or an infinity poisons the statistics
+    while it is in the buffer only.
+*/
+template <typename T, size_t N>
+class StatisticRingBuffer : public RingBuffer<T, N>
+{
+private:
+    typedef RingBuffer<T, N> Ring;
+
+    double sum;
+    double sum_of_squares;
+    double index_weighted_sum;      // sum of (chronological index * value), for the slope
+    size_t enqueue_since_renormalise;
+
+    void renormalise() {
+        sum = 0.0;
+        sum_of_squares = 0.0;
+        index_weighted_sum = 0.0;
+
+        for (size_t idx = 0; idx < this->getCounter(); idx++) {
+            double value = ring_buffer_value((*this)[idx]);
+
+            sum += value;
+            sum_of_squares += value * value;
+            index_weighted_sum += idx * value;
+        }
+
+        enqueue_since_renormalise = 0;
+    }
+
+    // Take the oldest element out of the statistics before it leaves the buffer, the remaining
+    // elements shift down by one index. Returns true if the sums have to be recomputed.
+    bool removeOldest() {
+        double oldest = ring_buffer_value(this->first());
+
+        sum -= oldest;
+        sum_of_squares -= oldest * oldest;
+        index_weighted_sum -= sum;
+
+        // Subtracting a non-finite value leaves the sums NaN
+        return !isfinite(oldest);
+    }
+
+public:
+    StatisticRingBuffer() {
+        reset();
+    }
+
+    void enqueue(const T & in) {
+        bool renormalise_required = false;
+        if (this->isFull()) {
+            renormalise_required = removeOldest();
+        }
+
+        Ring::enqueue(in);
+
+        double value = ring_buffer_value(in);
+        sum += value;
+        sum_of_squares += value * value;
+        index_weighted_sum += (this->getCounter() - 1) * value;
+
+        if (++enqueue_since_renormalise >= RING_BUFFER_RENORMALISE_INTERVAL || renormalise_required) {
+            renormalise();
+        }
+    }
+
+    T dequeue() {
+        if (this->getCounter() == 0) {
+            return Ring::dequeue();
+        }
+
+        bool renormalise_required = removeOldest();
+
+        T temp = Ring::dequeue();
+
+        if (renormalise_required) {
+            renormalise();
+        }
+
+        return temp;
+    }
+
+    void reset() {
+        Ring::reset();
+
+        sum = 0.0;
+        sum_of_squares = 0.0;
+        index_weighted_sum = 0.0;
+        enqueue_since_renormalise = 0;
+    }
+
+    // Arithmetic operatings (constant time, over the valid elements only)
+    double getSum() const { return sum; }
+
+    float getMean() const {
+        if (this->getCounter() == 0) {
+            return 0.0f;
+        }
+
+        return sum / this->getCounter();
+    }
+
+    float getVariance() const {
+        size_t count = this->getCounter();
+        if (count == 0) {
+            return 0.0f;
+        }
+
+        double mean = sum / count;
+        double variance = sum_of_squares / count - mean * mean;
+
+        // Rounding can leave a tiny negative value for a constant signal
+        return variance > 0.0 ? variance : 0.0f;
+    }
+
+    float getSd() const { return sqrtf(getVariance()); }
+
+    // Scanned on each call: on a rising or a falling signal the oldest element is the min or the max,
+    // tracking them would rescan the buffer on every enqueue
+    float getMin() const {
+        double min_value = INFINITY;
+        for (size_t idx = 0; idx < this->getCounter(); idx++) {
+            min_value = fmin(min_value, ring_buffer_value((*this)[idx]));
+        }
+
+        return min_value;
+    }
+
+    float getMax() const {
+        double max_value = -INFINITY;
+        for (size_t idx = 0; idx < this->getCounter(); idx++) {
+            max_value = fmax(max_value, ring_buffer_value((*this)[idx]));
+        }
+
+        return max_value;
+    }
+
+    // Least squares slope over the valid elements, in unit per sample. Positive when the value rises.
+    float getSlope() const {
+        size_t count = this->getCounter();
+        if (count < 2) {
+            return 0.0f;
+        }
+
+        double n = count;
+        double sum_of_index = n * (n - 1) / 2;
+        double sum_of_index_squares = (n - 1) * n * (2 * n - 1) / 6;
+
+        return (n * index_weighted_sum - sum_of_index * sum) / (n * sum_of_index_squares - sum_of_index * sum_of_index);
+    }
+};
+
+#endif  // RINGBUFFER_H_
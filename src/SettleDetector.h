@@ -0,0 +1,170 @@
+#ifndef SETTLEDETECTOR_H_
+#define SETTLEDETECTOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "RingBuffer.h"
+
+
+// Fewest samples to call the reading stable, fewer are needed once the scale proves it flags the motion
+#define SETTLE_DETECTOR_MIN_SAMPLE_CNT              5
+#define SETTLE_DETECTOR_MIN_FLAGGED_SAMPLE_CNT      3
+
+// A sample this many margins away from the window mean is a new load, the window restarts from it
+#define SETTLE_DETECTOR_STEP_MARGIN_CNT             5.0f
+
+
+typedef struct {
+    float weight;
+    uint64_t timestamp_us;
+} settle_sample_t;
+
+
+inline double ring_buffer_value(const settle_sample_t & sample) {
+    return sample.weight;
+}
+
+
+/*
+    Decides when the scale reading has settled, checked on every sample at the native rate of the scale.
+
+    The window holds the stable frames since the last disturbance: a step away from the window mean or a
+    frame the scale flags as unstable (A&D US, Radwag ?) restarts it, and it grows up to N samples. The reading
+    is stable once, over the window:
+    - the upper 95% confidence bound of the standard deviation is within the margin. Few samples give a
+      loose bound, so a quiet scale passes early and a noisy one waits for more samples.
+    - the least squares drift across the window is within the margin, which rejects a slow creep.
+    Drivers without a stability flag report every frame as stable, so the shorter minimum window applies
+    only once the driver declares the flag or the scale has flagged an unstable frame.
+*/
+template <size_t N>
+class SettleDetector
+{
+    static_assert(N >= SETTLE_DETECTOR_MIN_SAMPLE_CNT, "SettleDetector window is shorter than the minimum sample count");
+
+private:
+    StatisticRingBuffer<settle_sample_t, N> window;
+    float margin;
+
+    bool scale_flags_motion;
+    bool stable;
+
+    // sqrt(df / chi2(0.05, df)): the 95% upper bound of the standard deviation over the sample estimate
+    static float sd_upper_bound_factor(size_t df) {
+        static const float factors[] = {
+            15.95f, 4.41f, 2.92f, 2.37f, 2.09f, 1.92f, 1.80f, 1.71f,
+            1.65f, 1.59f, 1.55f, 1.52f, 1.49f, 1.46f, 1.44f,
+        };
+        const size_t factor_cnt = sizeof(factors) / sizeof(factors[0]);
+
+        if (df == 0) {
+            return INFINITY;
+        }
+
+        return factors[(df < factor_cnt ? df : factor_cnt) - 1];
+    }
+
+    bool evaluate() const {
+        size_t count = window.getCounter();
+        size_t min_count = scale_flags_motion ? SETTLE_DETECTOR_MIN_FLAGGED_SAMPLE_CNT : SETTLE_DETECTOR_MIN_SAMPLE_CNT;
+        if (count < min_count) {
+            return false;
+        }
+
+        // Variance test on the unbiased estimate
+        float sample_sd = window.getSd() * sqrtf((float) count / (count - 1));
+        if (sample_sd * sd_upper_bound_factor(count - 1) >= margin) {
+            return false;
+        }
+
+        // Slope test
+        float span_s = (window.last().timestamp_us - window.first().timestamp_us) * 1e-6f;
+        if (fabsf(getSlope()) * span_s >= margin) {
+            return false;
+        }
+
+        return true;
+    }
+
+public:
+    SettleDetector(float margin=0.0f) : margin(margin), scale_flags_motion(false) {
+        reset();
+    }
+
+    void setMargin(float margin) {
+        this->margin = margin;
+    }
+
+    // The scale driver declares the stability flag, no need to wait for an unstable frame to trust it
+    void setScaleFlagsMotion(bool scale_flags_motion) {
+        this->scale_flags_motion = scale_flags_motion;
+    }
+
+    // Restart the window, the scale stability flag support learnt so far is kept
+    void reset() {
+        window.reset();
+        stable = false;
+    }
+
+    // Add a sample, returns true if the reading is stable
+    bool update(float weight, uint64_t timestamp_us, bool scale_stable) {
+        // The scale is still settling, the window starts over from the next stable frame
+        if (!scale_stable) {
+            scale_flags_motion = true;
+            reset();
+            return false;
+        }
+
+        if (window.getCounter() > 0 && fabsf(weight - window.getMean()) > SETTLE_DETECTOR_STEP_MARGIN_CNT * margin) {
+            window.reset();
+        }
+
+        settle_sample_t sample = {
+            .weight = weight,
+            .timestamp_us = timestamp_us,
+        };
+        window.enqueue(sample);
+
+        stable = evaluate();
+        return stable;
+    }
+
+    bool isStable() const { return stable; }
+    size_t getCounter() const { return window.getCounter(); }
+    float getMean() const { return window.getMean(); }
+    float getSd() const { return window.getSd(); }
+
+    // Least squares slope over the window, in weight per second
+    float getSlope() const {
+        size_t count = window.getCounter();
+        if (count < 2) {
+            return 0.0f;
+        }
+
+        // Times relative to the oldest sample keep the float precision
+        double mean_t = 0.0;
+        for (size_t idx = 0; idx < count; idx++) {
+            mean_t += (window[idx].timestamp_us - window.first().timestamp_us) * 1e-6;
+        }
+        mean_t /= count;
+
+        double mean_weight = window.getMean();
+        double sxy = 0.0;
+        double sxx = 0.0;
+        for (size_t idx = 0; idx < count; idx++) {
+            double dt = (window[idx].timestamp_us - window.first().timestamp_us) * 1e-6 - mean_t;
+            sxy += dt * (window[idx].weight - mean_weight);
+            sxx += dt * dt;
+        }
+
+        if (sxx <= 0.0) {
+            return 0.0f;
+        }
+
+        return sxy / sxx;
+    }
+};
+
+#endif  // SETTLEDETECTOR_H_
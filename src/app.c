@@ -27,6 +27,7 @@
 #include "menu.h"
 #include "profile.h"
 #include "servo_gate.h"
+#include "charge_batch.h"
 
 
 int main()
@@ -55,6 +56,7 @@ int main()
 
     // Initialize charge mode settings
     charge_mode_config_init();
+    charge_batch_init();
 
     // Initialize profile data
     profile_data_init();
@@ -17,6 +17,8 @@ typedef enum {
     APP_STATE_ENTER_EEPROM_ERASE = 8,
     APP_STATE_ENTER_REBOOT = 9,
     APP_STATE_ENTER_WIFI_INFO = 10,
+    APP_STATE_ENTER_AUTOTUNE_MODE = 11,
+    APP_STATE_ENTER_BATCH_MODE = 12,
 } AppState_t;
 
 
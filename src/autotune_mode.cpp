@@ -0,0 +1,486 @@
+#include <FreeRTOS.h>
+#include <queue.h>
+#include <task.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "app.h"
+#include "u8g2.h"
+#include "mini_12864_module.h"
+#include "motors.h"
+#include "scale.h"
+#include "display.h"
+#include "common.h"
+#include "charge_mode.h"
+#include "autotune_mode.h"
+#include "profile.h"
+#include "servo_gate.h"
+#include "RingBuffer.h"
+
+
+// Step experiment
+#define AUTOTUNE_COARSE_SPEED_RATIO     0.25f       // Step speed, share of the maximum speed of the profile
+#define AUTOTUNE_FINE_SPEED_RATIO       0.5f
+#define AUTOTUNE_COARSE_STEP_WEIGHT     30.0f       // The step ends once this weight is delivered
+#define AUTOTUNE_FINE_STEP_WEIGHT       3.0f
+#define AUTOTUNE_STEP_MAX_TIME_S        20.0f
+#define AUTOTUNE_SETTLE_TIME_MS         2000        // Wait for the powder to land after the step
+
+// Model fit
+#define AUTOTUNE_STABLE_SAMPLE_CNT      10
+#define AUTOTUNE_DETECTION_RATIO        0.02f       // The response has started once 2% of the step weight is delivered
+#define AUTOTUNE_FIT_START_RATIO        0.3f        // Only the steady ramp after 30% of the step weight is fitted
+#define AUTOTUNE_MIN_FIT_SAMPLE_CNT     10
+
+// Gain calculation
+#define AUTOTUNE_MIN_DEAD_TIME_S        0.1f
+#define AUTOTUNE_CLOSED_LOOP_RATIO      4.0f        // Closed loop time constant, in multiples of the dead time
+
+
+// Memory from other modules
+extern QueueHandle_t encoder_event_queue;
+extern charge_mode_config_t charge_mode_config;
+extern servo_gate_t servo_gate;
+extern scale_config_t scale_config;
+extern AppState_t exit_state;
+
+// Internal
+autotune_mode_config_t autotune_mode_config;
+
+static QueueHandle_t autotune_scale_subscriber = NULL;
+static char title_string[30];
+TaskHandle_t autotune_render_task_handler = NULL;
+
+
+static const char * autotune_step_to_string(autotune_step_t step) {
+    switch (step) {
+        case AUTOTUNE_STEP_WAIT_FOR_ZERO:
+            return "Zero";
+        case AUTOTUNE_STEP_COARSE_TRICKLER:
+            return "Coarse";
+        case AUTOTUNE_STEP_FINE_TRICKLER:
+            return "Fine";
+        case AUTOTUNE_STEP_COMPLETE:
+            return "Complete";
+        case AUTOTUNE_STEP_FAILED:
+            return "Failed";
+        case AUTOTUNE_STEP_IDLE:
+        default:
+            return "Idle";
+    }
+}
+
+
+void autotune_render_task(void *p) {
+    char buf[32];
+
+    u8g2_t * display_handler = get_display_handler();
+
+    while (true) {
+        TickType_t last_render_tick = xTaskGetTickCount();
+
+        u8g2_ClearBuffer(display_handler);
+
+        // Draw title
+        snprintf(title_string, sizeof(title_string), "Autotune: %s", autotune_step_to_string(autotune_mode_config.autotune_step));
+        u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
+        u8g2_DrawStr(display_handler, 5, 10, title_string);
+
+        // Draw line
+        u8g2_DrawHLine(display_handler, 0, 13, u8g2_GetDisplayWidth(display_handler));
+
+        // Draw current weight
+        char weight_string[WEIGHT_STRING_LEN];
+        float_to_string(weight_string, scale_get_current_measurement(), charge_mode_config.eeprom_charge_mode_data.decimal_places);
+
+        memset(buf, 0x0, sizeof(buf));
+        sprintf(buf, "Weight: %s", weight_string);
+        u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
+        u8g2_DrawStr(display_handler, 5, 25, buf);
+
+        // Draw the fitted plant of each trickler: gain, dead time and time constant
+        const autotune_plant_t * coarse_plant = &autotune_mode_config.coarse_result.plant;
+        memset(buf, 0x0, sizeof(buf));
+        sprintf(buf, "C:K%0.3f L%0.2f T%0.2f", coarse_plant->gain, coarse_plant->dead_time_s, coarse_plant->time_constant_s);
+        u8g2_DrawStr(display_handler, 5, 35, buf);
+
+        const autotune_plant_t * fine_plant = &autotune_mode_config.fine_result.plant;
+        memset(buf, 0x0, sizeof(buf));
+        sprintf(buf, "F:K%0.3f L%0.2f T%0.2f", fine_plant->gain, fine_plant->dead_time_s, fine_plant->time_constant_s);
+        u8g2_DrawStr(display_handler, 5, 45, buf);
+
+        // Draw progress
+        memset(buf, 0x0, sizeof(buf));
+        switch (autotune_mode_config.autotune_step) {
+            case AUTOTUNE_STEP_COMPLETE:
+                sprintf(buf, "Saved, press to exit");
+                break;
+            case AUTOTUNE_STEP_FAILED:
+                sprintf(buf, "%s", autotune_mode_config.error ? autotune_mode_config.error : "Unknown");
+                break;
+            default:
+                sprintf(buf, "Progress: %d%%", (int) (autotune_mode_config.progress * 100));
+                break;
+        }
+        u8g2_DrawStr(display_handler, 5, 55, buf);
+
+        u8g2_SendBuffer(display_handler);
+
+        vTaskDelayUntil(&last_render_tick, pdMS_TO_TICKS(50));
+    }
+}
+
+
+/*
+    Poll the buttons while an experiment runs. Returns true if the user asks to leave.
+*/
+static bool autotune_should_exit() {
+    ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
+    if (button_encoder_event == BUTTON_RST_PRESSED) {
+        autotune_mode_config.autotune_mode_state = AUTOTUNE_MODE_EXIT;
+    }
+
+    return autotune_mode_config.autotune_mode_state == AUTOTUNE_MODE_EXIT;
+}
+
+
+/*
+    Wait for consecutive samples within the set point margin of the charge mode. Returns false if the
+    user leaves in the meantime.
+*/
+static bool autotune_wait_for_stable(float * mean) {
+    StatisticRingBuffer<float, AUTOTUNE_STABLE_SAMPLE_CNT> data_buffer;
+
+    while (true) {
+        if (autotune_should_exit()) {
+            return false;
+        }
+
+        scale_measurement_t sample;
+        if (!scale_wait_for_next_sample(autotune_scale_subscriber, 200, &sample)) {
+            continue;
+        }
+        data_buffer.enqueue(sample.weight);
+
+        if (data_buffer.isFull() && data_buffer.getSd() < charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin) {
+            *mean = data_buffer.getMean();
+            return true;
+        }
+    }
+}
+
+
+/*
+    Zero the scale with the cup on it.
+*/
+static bool autotune_wait_for_zero() {
+    float mean;
+    if (!autotune_wait_for_stable(&mean)) {
+        return false;
+    }
+
+    while (fabsf(mean) >= charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin) {
+        scale_config.scale_handle->force_zero();
+
+        if (!autotune_wait_for_stable(&mean)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void autotune_fail(const char * error) {
+    autotune_mode_config.error = error;
+    autotune_mode_config.autotune_step = AUTOTUNE_STEP_FAILED;
+}
+
+
+/*
+    Step the trickler from rest to the given speed and fit the response. The weight of an integrating
+    plant with dead time L and lag T approaches the line K * speed * (t - L - T). The slope of the
+    line gives K and where the line crosses the baseline gives L + T. L is taken from the first rise
+    above the baseline, as the flow varies too much for the crossing alone to be reliable.
+
+    Returns false if the user leaves, the scale stops reporting or the fit fails, the latter two also
+    set the error.
+*/
+static bool autotune_run_step(motor_select_t selected_motor, float speed, float step_weight, autotune_plant_t * plant) {
+    autotune_mode_config.progress = 0.0f;
+
+    float baseline;
+    if (!autotune_wait_for_stable(&baseline)) {
+        return false;
+    }
+
+    uint64_t start_time_us = time_us_64();
+    motor_set_speed(selected_motor, speed);
+
+    float dead_time_s = -1.0f;
+    double sum_t = 0.0, sum_w = 0.0, sum_tt = 0.0, sum_tw = 0.0;
+    uint32_t fit_sample_cnt = 0;
+
+    while (true) {
+        if (autotune_should_exit()) {
+            motor_set_speed(selected_motor, 0);
+            return false;
+        }
+
+        scale_measurement_t sample;
+        if (!scale_wait_for_next_sample(autotune_scale_subscriber, 200, &sample)) {
+            // The time limit is checked here too, otherwise a silent scale keeps the trickler running
+            if ((time_us_64() - start_time_us) / 1e6f > AUTOTUNE_STEP_MAX_TIME_S) {
+                motor_set_speed(selected_motor, 0);
+                autotune_fail("No scale data");
+                return false;
+            }
+            continue;
+        }
+
+        float t = (int64_t) (sample.timestamp_us - start_time_us) / 1e6f;
+        float delivered_weight = sample.weight - baseline;
+        autotune_mode_config.progress = fminf(1.0f, fmaxf(0.0f, delivered_weight / step_weight));
+
+        if (dead_time_s < 0 && delivered_weight > AUTOTUNE_DETECTION_RATIO * step_weight) {
+            dead_time_s = t;
+        }
+
+        if (delivered_weight >= AUTOTUNE_FIT_START_RATIO * step_weight) {
+            sum_t += t;
+            sum_w += delivered_weight;
+            sum_tt += t * t;
+            sum_tw += t * delivered_weight;
+            fit_sample_cnt += 1;
+        }
+
+        if (delivered_weight >= step_weight || t > AUTOTUNE_STEP_MAX_TIME_S) {
+            break;
+        }
+    }
+
+    motor_set_speed(selected_motor, 0);
+
+    // Let the powder land before the next experiment
+    TickType_t settle_start_tick = xTaskGetTickCount();
+    while (xTaskGetTickCount() - settle_start_tick < pdMS_TO_TICKS(AUTOTUNE_SETTLE_TIME_MS)) {
+        if (autotune_should_exit()) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+
+    if (dead_time_s < 0) {
+        autotune_fail("No flow detected");
+        return false;
+    }
+    if (fit_sample_cnt < AUTOTUNE_MIN_FIT_SAMPLE_CNT) {
+        autotune_fail("Too few samples");
+        return false;
+    }
+
+    double n = fit_sample_cnt;
+    double slope = (n * sum_tw - sum_t * sum_w) / (n * sum_tt - sum_t * sum_t);
+    if (!(slope > 0)) {
+        autotune_fail("No flow detected");
+        return false;
+    }
+    double intercept = (sum_w - slope * sum_t) / n;
+    float apparent_lag_s = -intercept / slope;
+
+    // The response starts a little before it is detected
+    plant->gain = slope / speed;
+    plant->dead_time_s = fmaxf(0.0f, dead_time_s - AUTOTUNE_DETECTION_RATIO * step_weight / slope);
+    plant->time_constant_s = fmaxf(0.0f, apparent_lag_s - plant->dead_time_s);
+
+    printf("Autotune: speed %0.3f, K %0.4f, L %0.3f, T %0.3f\n",
+           speed, plant->gain, plant->dead_time_s, plant->time_constant_s);
+
+    return true;
+}
+
+
+/*
+    SIMC rule for an integrating plant with lag, in the PD form. The closed loop time constant is a
+    multiple of the dead time. The plant integrates the flow already, so no integral action is used:
+    it only adds overshoot when approaching the target from below.
+*/
+static void autotune_calculate_gains(autotune_result_t * result) {
+    float dead_time_s = fmaxf(result->plant.dead_time_s, AUTOTUNE_MIN_DEAD_TIME_S);
+    float closed_loop_time_s = AUTOTUNE_CLOSED_LOOP_RATIO * dead_time_s;
+
+    float kc = 1.0f / (result->plant.gain * (closed_loop_time_s + dead_time_s));
+
+    result->kp = kc;
+    result->ki = 0.0f;
+    result->kd = kc * result->plant.time_constant_s * 1000.0f;  // The derivative is taken per ms
+}
+
+
+static void autotune_run() {
+    profile_t * current_profile = profile_get_selected();
+
+    float coarse_speed = AUTOTUNE_COARSE_SPEED_RATIO * fminf(get_motor_max_speed(SELECT_COARSE_TRICKLER_MOTOR),
+                                                             current_profile->coarse_max_flow_speed_rps);
+    coarse_speed = fmaxf(coarse_speed, fmaxf(get_motor_min_speed(SELECT_COARSE_TRICKLER_MOTOR),
+                                             current_profile->coarse_min_flow_speed_rps));
+    float fine_speed = AUTOTUNE_FINE_SPEED_RATIO * fminf(get_motor_max_speed(SELECT_FINE_TRICKLER_MOTOR),
+                                                         current_profile->fine_max_flow_speed_rps);
+    fine_speed = fmaxf(fine_speed, fmaxf(get_motor_min_speed(SELECT_FINE_TRICKLER_MOTOR),
+                                         current_profile->fine_min_flow_speed_rps));
+
+    autotune_mode_config.autotune_step = AUTOTUNE_STEP_WAIT_FOR_ZERO;
+    if (!autotune_wait_for_zero()) {
+        return;
+    }
+
+    autotune_mode_config.autotune_step = AUTOTUNE_STEP_COARSE_TRICKLER;
+    if (!autotune_run_step(SELECT_COARSE_TRICKLER_MOTOR, coarse_speed, AUTOTUNE_COARSE_STEP_WEIGHT, &autotune_mode_config.coarse_result.plant)) {
+        return;
+    }
+
+    autotune_mode_config.autotune_step = AUTOTUNE_STEP_FINE_TRICKLER;
+    if (!autotune_run_step(SELECT_FINE_TRICKLER_MOTOR, fine_speed, AUTOTUNE_FINE_STEP_WEIGHT, &autotune_mode_config.fine_result.plant)) {
+        return;
+    }
+
+    autotune_calculate_gains(&autotune_mode_config.coarse_result);
+    autotune_calculate_gains(&autotune_mode_config.fine_result);
+
+    // Write the gains into the selected profile
+    current_profile->coarse_kp = autotune_mode_config.coarse_result.kp;
+    current_profile->coarse_ki = autotune_mode_config.coarse_result.ki;
+    current_profile->coarse_kd = autotune_mode_config.coarse_result.kd;
+    current_profile->fine_kp = autotune_mode_config.fine_result.kp;
+    current_profile->fine_ki = autotune_mode_config.fine_result.ki;
+    current_profile->fine_kd = autotune_mode_config.fine_result.kd;
+    profile_data_save();
+
+    autotune_mode_config.progress = 1.0f;
+    autotune_mode_config.autotune_step = AUTOTUNE_STEP_COMPLETE;
+}
+
+
+uint8_t autotune_mode_menu() {
+    // Subscribe to the scale on the first entry, otherwise drop the samples received while away
+    if (autotune_scale_subscriber == NULL) {
+        autotune_scale_subscriber = scale_subscribe(8);
+        if (autotune_scale_subscriber == NULL) {
+            return 1;  // return back to main menu
+        }
+    }
+    else {
+        xQueueReset(autotune_scale_subscriber);
+    }
+
+    // If the display task is never created then we shall create one, otherwise we shall resume the task
+    if (autotune_render_task_handler == NULL) {
+        // The render task shall have lower priority than the current one
+        UBaseType_t current_task_priority = uxTaskPriorityGet(xTaskGetCurrentTaskHandle());
+        xTaskCreate(autotune_render_task, "Autotune Render Task", configMINIMAL_STACK_SIZE, NULL, current_task_priority - 1, &autotune_render_task_handler);
+    }
+    else {
+        vTaskResume(autotune_render_task_handler);
+    }
+
+    // Initialize the autotune mode config
+    memset(&autotune_mode_config, 0x0, sizeof(autotune_mode_config));
+    autotune_mode_config.autotune_mode_state = AUTOTUNE_MODE_ENTER;
+
+    // Enable both motors
+    motor_enable(SELECT_COARSE_TRICKLER_MOTOR, true);
+    motor_enable(SELECT_FINE_TRICKLER_MOTOR, true);
+
+    // Open servo gate (if enabled)
+    if (servo_gate.gate_state != GATE_DISABLED) {
+        servo_gate_set_ratio(SERVO_GATE_RATIO_OPEN, true);
+    }
+
+    autotune_run();
+
+    // Keep the result on the display until the user leaves
+    while (autotune_mode_config.autotune_mode_state != AUTOTUNE_MODE_EXIT) {
+        ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(true);
+        if (button_encoder_event == BUTTON_RST_PRESSED || button_encoder_event == BUTTON_ENCODER_PRESSED) {
+            autotune_mode_config.autotune_mode_state = AUTOTUNE_MODE_EXIT;
+        }
+    }
+
+    motor_set_speed(SELECT_BOTH_MOTOR, 0);
+    motor_enable(SELECT_COARSE_TRICKLER_MOTOR, false);
+    motor_enable(SELECT_FINE_TRICKLER_MOTOR, false);
+
+    vTaskSuspend(autotune_render_task_handler);
+    return 1;  // Return backs to the main menu view
+}
+
+
+bool http_rest_autotune_mode_state(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // s0 (autotune_mode_state_t | int): Autotune mode state
+    // s1 (autotune_step_t | int): Current experiment (read only)
+    // s2 (float): Progress of the current experiment, 0 to 1 (read only)
+    // s3 (str): Reason of the failure, empty otherwise (read only)
+    // c0 (float): Coarse trickler gain, weight per revolution (read only)
+    // c1 (float): Coarse trickler dead time in s (read only)
+    // c2 (float): Coarse trickler time constant in s (read only)
+    // c3 (float): Coarse trickler kp (read only)
+    // c4 (float): Coarse trickler ki (read only)
+    // c5 (float): Coarse trickler kd (read only)
+    // f0 - f5 (float): Same as c0 - c5 for the fine trickler (read only)
+
+    static char autotune_mode_json_buffer[384];
+
+    // Control
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "s0") == 0) {
+            autotune_mode_state_t new_state = (autotune_mode_state_t) atoi(values[idx]);
+
+            // Exit
+            if (new_state == AUTOTUNE_MODE_EXIT && autotune_mode_config.autotune_mode_state != AUTOTUNE_MODE_EXIT) {
+                ButtonEncoderEvent_t button_event = BUTTON_RST_PRESSED;
+                xQueueSend(encoder_event_queue, &button_event, portMAX_DELAY);
+            }
+
+            // Enter
+            else if (new_state == AUTOTUNE_MODE_ENTER && autotune_mode_config.autotune_mode_state != AUTOTUNE_MODE_ENTER) {
+                // Set exit_status for the menu
+                exit_state = APP_STATE_ENTER_AUTOTUNE_MODE;
+
+                // Then signal the menu to stop
+                ButtonEncoderEvent_t button_event = OVERRIDE_FROM_REST;
+                xQueueSend(encoder_event_queue, &button_event, portMAX_DELAY);
+            }
+
+            autotune_mode_config.autotune_mode_state = new_state;
+        }
+    }
+
+    const autotune_result_t * coarse = &autotune_mode_config.coarse_result;
+    const autotune_result_t * fine = &autotune_mode_config.fine_result;
+
+    // Response
+    snprintf(autotune_mode_json_buffer,
+             sizeof(autotune_mode_json_buffer),
+             "%s"
+             "{\"s0\":%d,\"s1\":%d,\"s2\":%0.3f,\"s3\":\"%s\","
+             "\"c0\":%0.4f,\"c1\":%0.3f,\"c2\":%0.3f,\"c3\":%0.4f,\"c4\":%0.4f,\"c5\":%0.4f,"
+             "\"f0\":%0.4f,\"f1\":%0.3f,\"f2\":%0.3f,\"f3\":%0.4f,\"f4\":%0.4f,\"f5\":%0.4f}",
+             http_json_header,
+             (int) autotune_mode_config.autotune_mode_state,
+             (int) autotune_mode_config.autotune_step,
+             autotune_mode_config.progress,
+             autotune_mode_config.error ? autotune_mode_config.error : "",
+             coarse->plant.gain, coarse->plant.dead_time_s, coarse->plant.time_constant_s,
+             coarse->kp, coarse->ki, coarse->kd,
+             fine->plant.gain, fine->plant.dead_time_s, fine->plant.time_constant_s,
+             fine->kp, fine->ki, fine->kd);
+
+    size_t data_length = strlen(autotune_mode_json_buffer);
+    file->data = autotune_mode_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef AUTOTUNE_MODE_H_
+#define AUTOTUNE_MODE_H_
+
+#include <stdint.h>
+#include "http_rest.h"
+#include "motors.h"
+
+
+typedef enum {
+    AUTOTUNE_MODE_EXIT = 0,
+    AUTOTUNE_MODE_ENTER = 1,
+} autotune_mode_state_t;
+
+
+// Experiments in the order they run
+typedef enum {
+    AUTOTUNE_STEP_IDLE = 0,
+    AUTOTUNE_STEP_WAIT_FOR_ZERO = 1,
+    AUTOTUNE_STEP_COARSE_TRICKLER = 2,
+    AUTOTUNE_STEP_FINE_TRICKLER = 3,
+    AUTOTUNE_STEP_COMPLETE = 4,
+    AUTOTUNE_STEP_FAILED = 5,
+} autotune_step_t;
+
+
+// Integrating plant with dead time and a first order lag, fitted from the step response of a trickler
+typedef struct {
+    float gain;                 // Weight per revolution
+    float dead_time_s;
+    float time_constant_s;
+} autotune_plant_t;
+
+
+// Result of the experiment on one trickler
+typedef struct {
+    autotune_plant_t plant;
+    float kp;
+    float ki;
+    float kd;
+} autotune_result_t;
+
+
+typedef struct {
+    autotune_mode_state_t autotune_mode_state;
+    autotune_step_t autotune_step;
+    float progress;                         // Share of the current experiment done, 0 to 1
+    const char * error;                     // Reason of the failure, NULL otherwise
+
+    autotune_result_t coarse_result;
+    autotune_result_t fine_result;
+} autotune_mode_config_t;
+
+
+// C Functions
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+uint8_t autotune_mode_menu();
+
+bool http_rest_autotune_mode_state(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}  // __cplusplus
+#endif
+
+#endif  // AUTOTUNE_MODE_H_
@@ -0,0 +1,367 @@
+#include <FreeRTOS.h>
+#include <queue.h>
+#include <semphr.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include "app.h"
+#include "mini_12864_module.h"
+#include "charge_mode.h"
+#include "charge_batch.h"
+#include "profile.h"
+#include "common.h"
+#include "RingBuffer.h"
+
+
+// Memory from other modules
+extern QueueHandle_t encoder_event_queue;
+extern charge_mode_config_t charge_mode_config;
+extern AppState_t exit_state;
+
+charge_batch_config_t charge_batch_config;
+
+
+static RingBuffer<charge_batch_result_t, CHARGE_BATCH_RESULT_LEN> charge_batch_results;
+
+static SemaphoreHandle_t charge_batch_mutex = NULL;
+
+
+bool charge_batch_init(void) {
+    charge_batch_mutex = xSemaphoreCreateMutex();
+    if (charge_batch_mutex == NULL) {
+        printf("Unable to create the batch mutex\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+void charge_batch_acquire(void) {
+    assert(charge_batch_mutex);
+
+    xSemaphoreTake(charge_batch_mutex, portMAX_DELAY);
+}
+
+
+void charge_batch_release(void) {
+    assert(charge_batch_mutex);
+
+    xSemaphoreGive(charge_batch_mutex);
+}
+
+
+static bool is_valid_entry(float target_charge_weight, uint8_t profile_idx, uint16_t charge_cnt) {
+    // Also rejects a NaN target
+    return target_charge_weight > 0 && target_charge_weight < CHARGE_BATCH_MAX_TARGET_CHARGE_WEIGHT &&
+           profile_idx < MAX_PROFILE_CNT &&
+           charge_cnt > 0 && charge_cnt <= CHARGE_BATCH_MAX_CHARGE_CNT;
+}
+
+
+bool charge_batch_add(float target_charge_weight, uint8_t profile_idx, uint16_t charge_cnt) {
+    if (!is_valid_entry(target_charge_weight, profile_idx, charge_cnt)) {
+        printf("Invalid batch entry: %0.3f, profile %u, count %u\n", target_charge_weight, profile_idx, charge_cnt);
+        return false;
+    }
+
+    charge_batch_acquire();
+
+    // Merge with the last entry if the target and the profile are the same
+    if (charge_batch_config.entry_cnt > 0) {
+        charge_batch_entry_t * last_entry = &charge_batch_config.entries[charge_batch_config.entry_cnt - 1];
+        if (last_entry->target_charge_weight == target_charge_weight && last_entry->profile_idx == profile_idx &&
+            last_entry->charge_cnt + charge_cnt <= CHARGE_BATCH_MAX_CHARGE_CNT) {
+            last_entry->charge_cnt += charge_cnt;
+
+            charge_batch_release();
+            return true;
+        }
+    }
+
+    if (charge_batch_config.entry_cnt >= CHARGE_BATCH_MAX_ENTRY_CNT) {
+        charge_batch_release();
+
+        printf("Batch is full (%d entries)\n", CHARGE_BATCH_MAX_ENTRY_CNT);
+        return false;
+    }
+
+    charge_batch_entry_t * entry = &charge_batch_config.entries[charge_batch_config.entry_cnt];
+    entry->target_charge_weight = target_charge_weight;
+    entry->profile_idx = profile_idx;
+    entry->charge_cnt = charge_cnt;
+
+    // A completed batch continues with the new entry
+    charge_batch_config.entry_cnt += 1;
+    if (charge_batch_config.charge_batch_state == CHARGE_BATCH_COMPLETE) {
+        charge_batch_config.charge_batch_state = CHARGE_BATCH_IDLE;
+    }
+
+    charge_batch_release();
+
+    return true;
+}
+
+
+void charge_batch_clear(void) {
+    charge_batch_acquire();
+
+    charge_batch_config.charge_batch_state = CHARGE_BATCH_IDLE;
+    charge_batch_config.entry_cnt = 0;
+    charge_batch_config.entry_idx = 0;
+    charge_batch_config.charge_idx = 0;
+
+    charge_batch_results.reset();
+
+    charge_batch_release();
+}
+
+
+bool charge_batch_start(void) {
+    charge_batch_acquire();
+
+    if (charge_batch_config.entry_cnt == 0) {
+        charge_batch_release();
+        return false;
+    }
+
+    // Run the batch again once complete, otherwise resume from the next charge
+    if (charge_batch_config.entry_idx >= charge_batch_config.entry_cnt) {
+        charge_batch_config.entry_idx = 0;
+        charge_batch_config.charge_idx = 0;
+        charge_batch_results.reset();
+    }
+
+    charge_batch_config.charge_batch_state = CHARGE_BATCH_RUNNING;
+
+    charge_batch_release();
+
+    return true;
+}
+
+
+void charge_batch_pause(void) {
+    charge_batch_acquire();
+
+    if (charge_batch_config.charge_batch_state == CHARGE_BATCH_RUNNING) {
+        charge_batch_config.charge_batch_state = CHARGE_BATCH_IDLE;
+    }
+
+    charge_batch_release();
+}
+
+
+bool charge_batch_is_running(void) {
+    // A single aligned read
+    return charge_batch_config.charge_batch_state == CHARGE_BATCH_RUNNING;
+}
+
+
+void charge_batch_load_next(void) {
+    charge_batch_acquire();
+
+    if (charge_batch_is_running()) {
+        const charge_batch_entry_t * entry = &charge_batch_config.entries[charge_batch_config.entry_idx];
+        charge_mode_config.target_charge_weight = entry->target_charge_weight;
+        profile_select(entry->profile_idx);
+    }
+
+    charge_batch_release();
+}
+
+
+bool charge_batch_record(float charge_weight, float elapsed_s) {
+    charge_batch_acquire();
+
+    if (!charge_batch_is_running()) {
+        charge_batch_release();
+        return false;
+    }
+
+    const charge_batch_entry_t * entry = &charge_batch_config.entries[charge_batch_config.entry_idx];
+
+    charge_batch_result_t result = {
+        .entry_idx = charge_batch_config.entry_idx,
+        .profile_idx = entry->profile_idx,
+        .target_charge_weight = entry->target_charge_weight,
+        .charge_weight = charge_weight,
+        .elapsed_s = elapsed_s,
+    };
+    charge_batch_results.enqueue(result);
+
+    printf("Batch %u/%u, charge %u/%u: target %0.3f, weight %0.3f, %0.2f s\n",
+           charge_batch_config.entry_idx + 1, charge_batch_config.entry_cnt,
+           charge_batch_config.charge_idx + 1, entry->charge_cnt,
+           result.target_charge_weight, result.charge_weight, result.elapsed_s);
+
+    // Advance
+    charge_batch_config.charge_idx += 1;
+    if (charge_batch_config.charge_idx >= entry->charge_cnt) {
+        charge_batch_config.entry_idx += 1;
+        charge_batch_config.charge_idx = 0;
+    }
+
+    bool is_running = true;
+    if (charge_batch_config.entry_idx >= charge_batch_config.entry_cnt) {
+        charge_batch_config.charge_batch_state = CHARGE_BATCH_COMPLETE;
+        printf("Batch complete\n");
+        is_running = false;
+    }
+
+    charge_batch_release();
+
+    return is_running;
+}
+
+
+uint8_t charge_batch_menu(void) {
+    if (!charge_batch_start()) {
+        return 22;  // Nothing queued, return to the batch page
+    }
+
+    return charge_mode_menu(true);
+}
+
+
+bool http_rest_charge_batch(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // a0 (float): Target charge weight of a new entry, each a0 starts an entry (write only)
+    // a1 (int): Profile index of the new entry, defaults to the selected profile (write only)
+    // a2 (int): Number of charges of the new entry, defaults to 1 (write only)
+    //      a0 - a2 can repeat to add several entries, long ladders take several requests
+    // rs (bool): Clear the queue and the results (write only)
+    // b0 (charge_batch_state_t | int): Batch state, write 1 to start or resume, 0 to stop
+    // b1 (int): Entry of the next charge
+    // b2 (int): Charges done in the entry of the next charge
+    // q (array): Queue, as [[target, profile index, count], ...] (read only)
+    // r (array): Recent results, as [[entry, target, weight, elapsed s], ...], the weight is "nan" if the scale was out of range (read only)
+    //      q and r are cut short if they do not fit the response
+
+    static char charge_batch_json_buffer[2560];
+
+    // Control
+    bool pending_entry = false;
+    charge_batch_entry_t new_entry;
+
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "a0") == 0) {
+            if (pending_entry) {
+                charge_batch_add(new_entry.target_charge_weight, new_entry.profile_idx, new_entry.charge_cnt);
+            }
+
+            pending_entry = true;
+            new_entry.target_charge_weight = strtof(values[idx], NULL);
+            new_entry.profile_idx = profile_get_selected_idx();
+            new_entry.charge_cnt = 1;
+        }
+        // Out of the range values are made invalid rather than truncated, charge_batch_add rejects them
+        else if (strcmp(params[idx], "a1") == 0 && pending_entry) {
+            int profile_idx = atoi(values[idx]);
+            new_entry.profile_idx = profile_idx >= 0 && profile_idx < MAX_PROFILE_CNT ? profile_idx : MAX_PROFILE_CNT;
+        }
+        else if (strcmp(params[idx], "a2") == 0 && pending_entry) {
+            int charge_cnt = atoi(values[idx]);
+            new_entry.charge_cnt = charge_cnt > 0 && charge_cnt <= CHARGE_BATCH_MAX_CHARGE_CNT ? charge_cnt : 0;
+        }
+        else if (strcmp(params[idx], "rs") == 0 && string_to_boolean(values[idx])) {
+            charge_batch_clear();
+        }
+        else if (strcmp(params[idx], "b0") == 0) {
+            charge_batch_state_t new_state = (charge_batch_state_t) atoi(values[idx]);
+
+            // Add the entries given before the start
+            if (pending_entry) {
+                charge_batch_add(new_entry.target_charge_weight, new_entry.profile_idx, new_entry.charge_cnt);
+                pending_entry = false;
+            }
+
+            // Stop, the charge mode exits as well
+            if (new_state == CHARGE_BATCH_IDLE && charge_batch_is_running()) {
+                charge_batch_pause();
+
+                if (charge_mode_config.charge_mode_state != CHARGE_MODE_EXIT) {
+                    ButtonEncoderEvent_t button_event = BUTTON_RST_PRESSED;
+                    xQueueSend(encoder_event_queue, &button_event, portMAX_DELAY);
+                }
+            }
+            // Start, only from outside of the charge mode
+            else if (new_state == CHARGE_BATCH_RUNNING && !charge_batch_is_running() &&
+                     charge_mode_config.charge_mode_state == CHARGE_MODE_EXIT && charge_batch_start()) {
+                // Set exit_status for the menu
+                exit_state = APP_STATE_ENTER_CHARGE_MODE_FROM_REST;
+
+                // Then signal the menu to stop
+                ButtonEncoderEvent_t button_event = OVERRIDE_FROM_REST;
+                xQueueSend(encoder_event_queue, &button_event, portMAX_DELAY);
+            }
+        }
+    }
+
+    if (pending_entry) {
+        charge_batch_add(new_entry.target_charge_weight, new_entry.profile_idx, new_entry.charge_cnt);
+    }
+
+    // Response, the charge mode can advance the batch meanwhile
+    charge_batch_acquire();
+
+    int len = snprintf(charge_batch_json_buffer,
+                       sizeof(charge_batch_json_buffer),
+                       "%s"
+                       "{\"b0\":%d,\"b1\":%u,\"b2\":%u,\"q\":[",
+                       http_json_header,
+                       (int) charge_batch_config.charge_batch_state,
+                       charge_batch_config.entry_idx,
+                       charge_batch_config.charge_idx);
+
+    // Leave room for the longest item and the closing brackets
+    for (int idx = 0;
+         idx < charge_batch_config.entry_cnt && sizeof(charge_batch_json_buffer) - len > 128;
+         idx += 1) {
+        const charge_batch_entry_t * entry = &charge_batch_config.entries[idx];
+
+        len += snprintf(charge_batch_json_buffer + len, sizeof(charge_batch_json_buffer) - len,
+                        "%s[%0.3f,%u,%u]",
+                        idx ? "," : "",
+                        entry->target_charge_weight,
+                        entry->profile_idx,
+                        entry->charge_cnt);
+    }
+
+    len += snprintf(charge_batch_json_buffer + len, sizeof(charge_batch_json_buffer) - len, "],\"r\":[");
+
+    for (size_t idx = 0;
+         idx < charge_batch_results.getCounter() && sizeof(charge_batch_json_buffer) - len > 128;
+         idx += 1) {
+        const charge_batch_result_t & result = charge_batch_results[idx];
+
+        char weight_string[16];
+        if (isnan(result.charge_weight)) {
+            sprintf(weight_string, "\"nan\"");
+        }
+        else {
+            snprintf(weight_string, sizeof(weight_string), "%0.3f", result.charge_weight);
+        }
+
+        len += snprintf(charge_batch_json_buffer + len, sizeof(charge_batch_json_buffer) - len,
+                        "%s[%u,%0.3f,%s,%0.2f]",
+                        idx ? "," : "",
+                        result.entry_idx,
+                        result.target_charge_weight,
+                        weight_string,
+                        result.elapsed_s);
+    }
+
+    snprintf(charge_batch_json_buffer + len, sizeof(charge_batch_json_buffer) - len, "]}");
+
+    charge_batch_release();
+
+    size_t data_length = strlen(charge_batch_json_buffer);
+    file->data = charge_batch_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
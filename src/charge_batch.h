@@ -0,0 +1,92 @@
+#ifndef CHARGE_BATCH_H_
+#define CHARGE_BATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+// Targets queued in a batch, a ladder of load development rarely exceeds 20 steps
+#define CHARGE_BATCH_MAX_ENTRY_CNT      20
+
+// Number of charge results kept for the REST interface, every result is also printed to the log
+#define CHARGE_BATCH_RESULT_LEN         50
+
+// Limits of an entry, the charge weight menu takes up to 999.99
+#define CHARGE_BATCH_MAX_TARGET_CHARGE_WEIGHT   1000.0f
+#define CHARGE_BATCH_MAX_CHARGE_CNT             999
+
+
+typedef enum {
+    CHARGE_BATCH_IDLE = 0,              // Not started or paused, a start resumes from the current entry
+    CHARGE_BATCH_RUNNING = 1,
+    CHARGE_BATCH_COMPLETE = 2,
+} charge_batch_state_t;
+
+
+typedef struct {
+    float target_charge_weight;
+    uint8_t profile_idx;
+    uint16_t charge_cnt;
+} charge_batch_entry_t;
+
+
+typedef struct {
+    uint8_t entry_idx;
+    uint8_t profile_idx;
+    float target_charge_weight;
+    float charge_weight;                // Measured after the charge settled
+    float elapsed_s;
+} charge_batch_result_t;
+
+
+typedef struct {
+    charge_batch_entry_t entries[CHARGE_BATCH_MAX_ENTRY_CNT];
+    uint8_t entry_cnt;
+
+    // Position of the next charge
+    uint8_t entry_idx;
+    uint16_t charge_idx;
+
+    charge_batch_state_t charge_batch_state;
+} charge_batch_config_t;
+
+
+// C Functions
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+bool charge_batch_init(void);
+
+// The batch is changed from the REST and the menu while the charge mode runs it. The functions below
+// hold the lock themselves, take it to read charge_batch_config directly.
+void charge_batch_acquire(void);
+void charge_batch_release(void);
+
+bool charge_batch_add(float target_charge_weight, uint8_t profile_idx, uint16_t charge_cnt);
+void charge_batch_clear(void);
+
+bool charge_batch_start(void);
+void charge_batch_pause(void);
+bool charge_batch_is_running(void);
+
+// Apply the target and the profile of the next charge to the charge mode
+void charge_batch_load_next(void);
+
+// Log the result of the charge and advance, returns false once the batch is complete
+bool charge_batch_record(float charge_weight, float elapsed_s);
+
+uint8_t charge_batch_menu(void);
+
+// REST interface
+bool http_rest_charge_batch(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+
+#ifdef __cplusplus
+}  // __cplusplus
+#endif
+
+
+#endif  // CHARGE_BATCH_H_
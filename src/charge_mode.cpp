@@ -8,9 +8,12 @@
 #include <semphr.h>
 #include <u8g2.h>
 #include <math.h>
+#include "pico/time.h"
 
 #include "app.h"
-#include "FloatRingBuffer.h"
+#include "RingBuffer.h"
+#include "PIDController.h"
+#include "SettleDetector.h"
 #include "mini_12864_module.h"
 #include "display.h"
 #include "scale.h"
@@ -21,6 +24,8 @@
 #include "profile.h"
 #include "common.h"
 #include "servo_gate.h"
+#include "flow_model.h"
+#include "charge_batch.h"
 
 
 uint8_t charge_weight_digits[] = {0, 0, 0, 0, 0};
@@ -30,6 +35,41 @@ charge_mode_config_t charge_mode_config;
 // Scale related
 extern scale_config_t scale_config;
 extern servo_gate_t servo_gate;
+extern eeprom_profile_model_data_t profile_model_data;
+
+// Number of recent samples used to estimate the flow rate
+#define FLOW_RATE_WINDOW                8
+
+// In-flight model learning
+#define FINE_STOP_DELAY_LEARNING_RATE   0.2f
+#define FINE_STOP_DELAY_MAX_S           2.0f
+#define MIN_LEARNING_FLOW_RATE          0.01f       // unit per second
+
+// Coarse stop threshold learning
+#define COARSE_STOP_LEARNING_RATE       0.5f
+#define COARSE_SETTLE_TIME_US           1000000     // Wait for the coarse trickler powder to land
+
+// Volumetric bulk charge learning
+#define BULK_CHARGE_LEARNING_RATE       0.3f
+
+// Flow model recording
+#define FLOW_MODEL_HISTORY_LEN          32          // Commanded speeds kept, one per sample
+#define FLOW_MODEL_DELAY_US             500000      // Powder fall time and the scale response
+#define FLOW_MODEL_MAX_SPEED_SPREAD     1.5f        // Largest ratio between the speeds commanded over the window
+
+// Inputs of the charge mode, the set holds one entry per item queued to a member. The scale drops
+// the oldest sample of a full subscriber, which leaves a stale entry, so the set has room for it.
+#define CHARGE_MODE_SUBSCRIBER_DEPTH    8
+#define CHARGE_MODE_INPUT_SET_LEN       (2 * CHARGE_MODE_SUBSCRIBER_DEPTH + 5)   // encoder_event_queue holds 5
+
+// Post charge pipeline, runs while waiting for the cup removal
+#define POST_CHARGE_SETTLE_TIME_US      1000000     // Fine trickler stop to the result measurement
+#define POST_CHARGE_UNSTABLE_TIMEOUT_US 2000000     // Longest extra wait for the scale to flag the result as stable
+#define PRECHARGE_GATE_SETTLE_TIME_US   500000      // Let the gate fully close before the precharge
+#define GATE_POLL_PERIOD_MS             20          // The gate reports the end of a move by a semaphore only
+
+// PID controller
+#define PID_DERIVATIVE_FILTER_TIME_S    0.1f        // About one scale sample, smooths the weight noise in the derivative
 
 
 const eeprom_charge_mode_data_t default_charge_mode_data = {
@@ -57,10 +97,24 @@ const eeprom_charge_mode_data_t default_charge_mode_data = {
 
 // Configures
 TaskHandle_t scale_measurement_render_task_handler = NULL;
+static QueueHandle_t charge_mode_scale_subscriber = NULL;
+static QueueSetHandle_t charge_mode_input_set = NULL;
 static char title_string[30];
 
 static TickType_t charge_start_tick = 0;
 static float last_charge_elapsed_seconds = 0.0f;
+static uint64_t charge_complete_time_us = 0;
+
+// Recorded when the fine trickler stops, consumed once the weight settles
+static bool charge_stop_recorded = false;
+static float charge_stop_weight = 0.0f;
+static float charge_stop_flow_rate = 0.0f;
+static bool profile_model_updated = false;
+
+// Time spent in each phase of the charge in progress, committed to the history once the cycle completes
+static uint32_t charge_phase_time_us[CHARGE_PHASE_CNT];
+static uint64_t charge_phase_start_us = 0;
+static StatisticRingBuffer<int32_t, CHARGE_TIMING_HISTORY_LEN> charge_phase_history[CHARGE_PHASE_CNT];
 
 // Menu system
 extern AppState_t exit_state;
@@ -76,6 +130,337 @@ typedef enum {
 } ChargeModeEventBit_t;
 
 
+// Input delivered to the charge mode states
+typedef enum {
+    CHARGE_INPUT_TIMEOUT = 0,
+    CHARGE_INPUT_SCALE_SAMPLE,
+    CHARGE_INPUT_BUTTON,
+} charge_input_type_t;
+
+typedef struct {
+    charge_input_type_t type;
+    scale_measurement_t sample;
+    ButtonEncoderEvent_t button_encoder_event;
+} charge_input_t;
+
+
+// Trickler speeds commanded at a sample, to relate the measured flow to the speed that delivered it
+typedef struct {
+    uint64_t timestamp_us;
+    float coarse_speed_rps;
+    float fine_speed_rps;
+} speed_command_t;
+
+
+typedef struct {
+    float mean;
+    float min;
+    float max;
+} speed_stat_t;
+
+
+/*
+    Least squares flow rate over the recent samples, in unit per second. Returns 0 if not enough 
+    samples are available.
+*/
+static float estimate_flow_rate(const RingBuffer<scale_measurement_t, FLOW_RATE_WINDOW> & samples) {
+    size_t n = samples.getCounter();
+    if (n < 3) {
+        return 0.0f;
+    }
+
+    // Use time relative to the oldest sample to keep the precision
+    uint64_t t0_us = samples.first().timestamp_us;
+    float sum_t = 0.0f, sum_w = 0.0f, sum_tt = 0.0f, sum_tw = 0.0f;
+    for (const scale_measurement_t & sample : samples) {
+        float t = (int64_t) (sample.timestamp_us - t0_us) / 1e6f;
+
+        sum_t += t;
+        sum_w += sample.weight;
+        sum_tt += t * t;
+        sum_tw += t * sample.weight;
+    }
+
+    float denominator = n * sum_tt - sum_t * sum_t;
+    if (denominator <= 0) {
+        return 0.0f;
+    }
+
+    return fmaxf(0.0f, (n * sum_tw - sum_t * sum_w) / denominator);
+}
+
+
+/*
+    Update the fine stop delay from the powder that landed after the fine trickler stops.
+*/
+static void update_fine_stop_delay(profile_model_t * model, float in_flight_weight, float flow_rate) {
+    if (flow_rate < MIN_LEARNING_FLOW_RATE) {
+        return;
+    }
+
+    float observed_delay_s = fminf(FINE_STOP_DELAY_MAX_S, fmaxf(0.0f, in_flight_weight / flow_rate));
+
+    model->fine_stop_delay_s += FINE_STOP_DELAY_LEARNING_RATE * (observed_delay_s - model->fine_stop_delay_s);
+    model->learned_charge_cnt += 1;
+
+    profile_model_updated = true;
+}
+
+
+/*
+    Use the learned coarse stop threshold of the profile if available, otherwise the charge mode setting.
+*/
+static float get_coarse_stop_threshold(profile_model_t * model) {
+    if (profile_model_data.adaptive_coarse_stop_enable && model->coarse_stop_threshold > 0) {
+        return model->coarse_stop_threshold;
+    }
+
+    return charge_mode_config.eeprom_charge_mode_data.coarse_stop_threshold;
+}
+
+
+/*
+    Move the coarse stop threshold so the weight left to the fine trickler converges to the target.
+*/
+static void update_coarse_stop_threshold(profile_model_t * model, float coarse_stop_threshold, float fine_trickle_weight) {
+    float target = profile_model_data.fine_trickle_target_weight;
+    float new_threshold = coarse_stop_threshold - COARSE_STOP_LEARNING_RATE * (fine_trickle_weight - target);
+
+    // Never stop the coarse trickler later than the target remaining weight
+    model->coarse_stop_threshold = fminf(profile_model_data.coarse_stop_threshold_max, fmaxf(target, new_threshold));
+
+    profile_model_updated = true;
+}
+
+
+/*
+    Update the weight per revolution of the coarse trickler from a bulk charge that has landed.
+*/
+static void update_coarse_weight_per_rev(profile_model_t * model, float thrown_weight, float revolutions) {
+    float observed_weight_per_rev = thrown_weight / revolutions;
+    if (observed_weight_per_rev <= 0) {
+        return;
+    }
+
+    // Take the first observation as is
+    if (model->coarse_weight_per_rev <= 0) {
+        model->coarse_weight_per_rev = observed_weight_per_rev;
+    }
+    else {
+        model->coarse_weight_per_rev += BULK_CHARGE_LEARNING_RATE * (observed_weight_per_rev - model->coarse_weight_per_rev);
+    }
+
+    profile_model_updated = true;
+}
+
+
+/*
+    Time weighted statistics of the speeds commanded between start_us and end_us. Each command holds
+    until the next one. Returns false if the history does not cover the period.
+*/
+static bool get_speed_command_stat(const RingBuffer<speed_command_t, FLOW_MODEL_HISTORY_LEN> & commands,
+                                   uint64_t start_us, uint64_t end_us,
+                                   speed_stat_t * coarse, speed_stat_t * fine) {
+    size_t n = commands.getCounter();
+    if (n == 0 || commands[0].timestamp_us > start_us || end_us <= start_us) {
+        return false;
+    }
+
+    float coarse_sum = 0.0f, fine_sum = 0.0f;
+    coarse->min = fine->min = INFINITY;
+    coarse->max = fine->max = 0.0f;
+
+    for (size_t idx = 0; idx < n; idx += 1) {
+        uint64_t hold_start_us = commands[idx].timestamp_us > start_us ? commands[idx].timestamp_us : start_us;
+        uint64_t hold_end_us = idx + 1 < n && commands[idx + 1].timestamp_us < end_us ? commands[idx + 1].timestamp_us : end_us;
+        if (hold_end_us <= hold_start_us) {
+            continue;
+        }
+
+        float duration = (hold_end_us - hold_start_us) / 1e6f;
+        const speed_command_t & command = commands[idx];
+
+        coarse_sum += command.coarse_speed_rps * duration;
+        fine_sum += command.fine_speed_rps * duration;
+        coarse->min = fminf(coarse->min, command.coarse_speed_rps);
+        coarse->max = fmaxf(coarse->max, command.coarse_speed_rps);
+        fine->min = fminf(fine->min, command.fine_speed_rps);
+        fine->max = fmaxf(fine->max, command.fine_speed_rps);
+    }
+
+    float period = (end_us - start_us) / 1e6f;
+    coarse->mean = coarse_sum / period;
+    fine->mean = fine_sum / period;
+
+    return true;
+}
+
+
+/*
+    Record the flow measured over the recent samples against the speed commanded when that powder left
+    the trickler. Only steady periods are used. The fine trickler is learned while the coarse trickler
+    is stopped, the coarse trickler while it runs with the fine trickler flow taken out.
+*/
+static void record_flow(profile_model_t * model,
+                        const RingBuffer<speed_command_t, FLOW_MODEL_HISTORY_LEN> & commands,
+                        const RingBuffer<scale_measurement_t, FLOW_RATE_WINDOW> & samples,
+                        float flow_rate) {
+    if (samples.getCounter() < FLOW_RATE_WINDOW || flow_rate < MIN_LEARNING_FLOW_RATE) {
+        return;
+    }
+
+    speed_stat_t coarse, fine;
+    if (!get_speed_command_stat(commands,
+                                samples.first().timestamp_us - FLOW_MODEL_DELAY_US,
+                                samples.last().timestamp_us - FLOW_MODEL_DELAY_US,
+                                &coarse, &fine)) {
+        return;
+    }
+
+    if (coarse.max == 0) {
+        // The coarse trickler powder must have landed before the window starts
+        speed_stat_t coarse_settle, fine_settle;
+        if (!get_speed_command_stat(commands,
+                                    samples.first().timestamp_us - COARSE_SETTLE_TIME_US,
+                                    samples.first().timestamp_us,
+                                    &coarse_settle, &fine_settle) || coarse_settle.max > 0) {
+            return;
+        }
+
+        if (fine.min > 0 && fine.max <= fine.min * FLOW_MODEL_MAX_SPEED_SPREAD) {
+            flow_model_update(&model->fine_flow_model, fine.mean, flow_rate / fine.mean);
+            profile_model_updated = true;
+        }
+    }
+    else if (coarse.min > 0 && coarse.max <= coarse.min * FLOW_MODEL_MAX_SPEED_SPREAD) {
+        float fine_flow_rate = fine.mean * flow_model_get_weight_per_rev(&model->fine_flow_model, fine.mean);
+        flow_model_update(&model->coarse_flow_model, coarse.mean, (flow_rate - fine_flow_rate) / coarse.mean);
+        profile_model_updated = true;
+    }
+}
+
+
+/*
+    Speed that delivers the remaining weight within the time budget, at the flow learned for the
+    current speed. Returns 0 if the feed-forward is disabled or the flow is not learned yet.
+*/
+static float get_feed_forward_speed(const flow_model_t * flow_model, float remaining_weight,
+                                    float time_budget_s, float current_speed) {
+    if (time_budget_s <= 0 || remaining_weight <= 0) {
+        return 0.0f;
+    }
+
+    float weight_per_rev = flow_model_get_weight_per_rev(flow_model, current_speed);
+    if (weight_per_rev <= 0) {
+        return 0.0f;
+    }
+
+    return remaining_weight / (time_budget_s * weight_per_rev);
+}
+
+
+/*
+    Queue the scale samples and the button events (local or from REST) to the charge mode input set.
+    Members have to be empty to join or leave a set, the critical section keeps the producers out.
+*/
+static bool charge_mode_attach_inputs() {
+    if (charge_mode_input_set == NULL) {
+        charge_mode_input_set = xQueueCreateSet(CHARGE_MODE_INPUT_SET_LEN);
+        if (charge_mode_input_set == NULL) {
+            return false;
+        }
+    }
+
+    taskENTER_CRITICAL();
+    xQueueReset(charge_mode_scale_subscriber);
+    xQueueReset(encoder_event_queue);
+    bool is_ok = xQueueAddToSet(charge_mode_scale_subscriber, charge_mode_input_set) == pdPASS &&
+                 xQueueAddToSet(encoder_event_queue, charge_mode_input_set) == pdPASS;
+    taskEXIT_CRITICAL();
+
+    return is_ok;
+}
+
+
+// The menu reads the encoder events directly once the charge mode leaves
+static void charge_mode_detach_inputs() {
+    if (charge_mode_input_set == NULL) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    xQueueReset(charge_mode_scale_subscriber);
+    xQueueReset(encoder_event_queue);
+    xQueueRemoveFromSet(charge_mode_scale_subscriber, charge_mode_input_set);
+    xQueueRemoveFromSet(encoder_event_queue, charge_mode_input_set);
+    xQueueReset(charge_mode_input_set);
+    taskEXIT_CRITICAL();
+}
+
+
+/*
+    Block until a scale sample or a button event arrives, or the timeout expires. A stale entry left in
+    the set by a dropped sample also returns as a timeout.
+*/
+static charge_input_t charge_mode_wait_for_input(TickType_t timeout_ticks) {
+    charge_input_t input = {
+        .type = CHARGE_INPUT_TIMEOUT,
+        .sample = {},
+        .button_encoder_event = BUTTON_NO_EVENT,
+    };
+
+    QueueSetMemberHandle_t member = xQueueSelectFromSet(charge_mode_input_set, timeout_ticks);
+
+    if (member == encoder_event_queue) {
+        if (xQueueReceive(encoder_event_queue, &input.button_encoder_event, 0) == pdTRUE) {
+            input.type = CHARGE_INPUT_BUTTON;
+        }
+    }
+    else if (member == charge_mode_scale_subscriber) {
+        if (xQueueReceive(charge_mode_scale_subscriber, &input.sample, 0) == pdTRUE) {
+            input.type = CHARGE_INPUT_SCALE_SAMPLE;
+        }
+    }
+
+    return input;
+}
+
+
+// Ticks left to a deadline on the time_us_64() clock, rounded up
+static TickType_t ticks_until(uint64_t deadline_us) {
+    int64_t remaining_us = (int64_t) (deadline_us - time_us_64());
+    if (remaining_us <= 0) {
+        return 0;
+    }
+
+    return pdMS_TO_TICKS((remaining_us + 999) / 1000);
+}
+
+
+static void charge_phase_begin() {
+    charge_phase_start_us = time_us_64();
+}
+
+
+/*
+    Record the time since the previous phase ended, the next phase starts immediately.
+*/
+static void charge_phase_end(charge_phase_t phase) {
+    uint64_t now_us = time_us_64();
+
+    charge_phase_time_us[phase] = now_us - charge_phase_start_us;
+    charge_phase_start_us = now_us;
+}
+
+
+static void charge_timing_commit() {
+    for (int phase = 0; phase < CHARGE_PHASE_CNT; phase += 1) {
+        charge_phase_history[phase].enqueue(charge_phase_time_us[phase]);
+        charge_phase_time_us[phase] = 0;
+    }
+}
+
+
 static void format_elapsed_time(char *buffer, size_t len, TickType_t start_tick) {
     TickType_t now = xTaskGetTickCount();
     uint32_t elapsed_ticks = now - start_tick;
@@ -159,44 +544,42 @@ void charge_mode_wait_for_zero() {
         true
     );
     
-    // Wait for 5 measurements and wait for stable
-    FloatRingBuffer data_buffer(10);
+    SettleDetector<16> settle_detector(charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin);
+    settle_detector.setScaleFlagsMotion(scale_config.scale_handle->reports_stability);
 
     // Update current status
     snprintf(title_string, sizeof(title_string), "Waiting for Zero");
 
-    // Stop condition: 10 stable measurements in 200ms apart (2 seconds minimum)
+    // A new charge cycle starts from here
+    charge_phase_begin();
+
+    // Stop condition: the reading settles within the margin of zero, checked on every sample
     while (true) {
-        TickType_t last_measurement_tick = xTaskGetTickCount();
+        charge_input_t input = charge_mode_wait_for_input(portMAX_DELAY);
 
-        // Non block waiting for the input
-        ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
-        if (button_encoder_event == BUTTON_RST_PRESSED) {
-            charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
-            return;
-        }
-        else if (button_encoder_event == BUTTON_ENCODER_PRESSED) {
-            scale_config.scale_handle->force_zero();
+        if (input.type == CHARGE_INPUT_BUTTON) {
+            if (input.button_encoder_event == BUTTON_RST_PRESSED) {
+                charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
+                return;
+            }
+            else if (input.button_encoder_event == BUTTON_ENCODER_PRESSED) {
+                scale_config.scale_handle->force_zero();
+                settle_detector.reset();
+            }
+            continue;
         }
-
-        // Perform measurement (max delay 300 seconds   )
-        float current_measurement;
-        if (scale_block_wait_for_next_measurement(300, &current_measurement)){
-            data_buffer.enqueue(current_measurement);
+        else if (input.type != CHARGE_INPUT_SCALE_SAMPLE) {
+            continue;
         }
 
         // Generate stop condition
-        if (data_buffer.getCounter() >= 10){
-            if (data_buffer.getSd() < charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin && 
-                abs(data_buffer.getMean()) < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin) {
-                break;
-            }
+        if (settle_detector.update(input.sample.weight, input.sample.timestamp_us, input.sample.is_stable && isfinite(input.sample.weight)) &&
+            fabsf(settle_detector.getMean()) < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin) {
+            break;
         }
-
-        // Wait for minimum 300 ms (but can skip if previously wait already)
-        vTaskDelayUntil(&last_measurement_tick, pdMS_TO_TICKS(300));
     }
 
+    charge_phase_end(CHARGE_PHASE_ZERO_WAIT);
     charge_mode_config.charge_mode_state = CHARGE_MODE_WAIT_FOR_COMPLETE;
 }
 
@@ -226,6 +609,12 @@ void charge_mode_wait_for_complete() {
 
     // Read trickling parameter from the current profile
     profile_t * current_profile = profile_get_selected();
+    profile_model_t * current_model = profile_get_selected_model();
+
+    // Recent samples for the flow rate estimation, and the speeds commanded for the flow model
+    RingBuffer<scale_measurement_t, FLOW_RATE_WINDOW> recent_samples;
+    RingBuffer<speed_command_t, FLOW_MODEL_HISTORY_LEN> speed_commands;
+    charge_stop_recorded = false;
 
     // Find the minimum of max speed from the motor and the profile
     float coarse_trickler_max_speed = fmin(get_motor_max_speed(SELECT_COARSE_TRICKLER_MOTOR),
@@ -237,55 +626,176 @@ void charge_mode_wait_for_complete() {
     float fine_trickler_min_speed = fmax(get_motor_min_speed(SELECT_FINE_TRICKLER_MOTOR),
                                          current_profile->fine_min_flow_speed_rps);
 
-    // Define PID terms
-    float coarse_trickler_integral = 0.0f;
-    float fine_trickler_integral = 0.0f;
-    float coarse_trickler_last_error = 0.0f;
-    float fine_trickler_last_error = 0.0f;
+    // Define PID controllers, the profile kd is kept in its original unit with the derivative taken per ms
+    PIDController coarse_trickler_pid;
+    coarse_trickler_pid.setGains(current_profile->coarse_kp, current_profile->coarse_ki, current_profile->coarse_kd / 1000.0f);
+    coarse_trickler_pid.setOutputLimits(coarse_trickler_min_speed, coarse_trickler_max_speed);
+    coarse_trickler_pid.setDerivativeFilter(PID_DERIVATIVE_FILTER_TIME_S);
+
+    PIDController fine_trickler_pid;
+    fine_trickler_pid.setGains(current_profile->fine_kp, current_profile->fine_ki, current_profile->fine_kd / 1000.0f);
+    fine_trickler_pid.setOutputLimits(fine_trickler_min_speed, fine_trickler_max_speed);
+    fine_trickler_pid.setDerivativeFilter(PID_DERIVATIVE_FILTER_TIME_S);
 
     // Calculate target weight for coarse trickler
     // The coarse trickler is suppose to stop ahead of the target weight by an offset
-    float coarse_trickler_target_charge_weight = fmaxf(0.0f, charge_mode_config.target_charge_weight - charge_mode_config.eeprom_charge_mode_data.coarse_stop_threshold);
+    float coarse_stop_threshold = get_coarse_stop_threshold(current_model);
+    float coarse_trickler_target_charge_weight = fmaxf(0.0f, charge_mode_config.target_charge_weight - coarse_stop_threshold);
 
-    TickType_t last_sample_tick = xTaskGetTickCount();
-    TickType_t current_sample_tick = last_sample_tick;
+    // Learn the threshold only if the coarse trickler takes part in the charge
+    bool should_learn_coarse_stop = profile_model_data.adaptive_coarse_stop_enable && coarse_trickler_target_charge_weight > 0;
+    uint64_t coarse_stop_time_us = 0;
+
+    uint64_t last_sample_time_us = time_us_64();
     bool should_coarse_trickler_move = true;
 
+    // Throw the bulk of the charge by counted revolutions at full speed. The PID takes over once the
+    // powder has landed and makes up the rest. Without a learned weight per revolution, a short throw
+    // is made to learn it.
+    bool bulk_charge_active = profile_model_data.bulk_charge_enable && coarse_trickler_target_charge_weight > 0;
+    float bulk_charge_rev = 0.0f;
+    uint64_t bulk_charge_start_time_us = time_us_64();
+    uint64_t bulk_charge_done_time_us = 0;
+    if (bulk_charge_active) {
+        if (current_model->coarse_weight_per_rev > 0) {
+            bulk_charge_rev = coarse_trickler_target_charge_weight * profile_model_data.bulk_charge_ratio / current_model->coarse_weight_per_rev;
+        }
+        else {
+            bulk_charge_rev = profile_model_data.bulk_charge_learn_rev;
+        }
+
+        bulk_charge_active = motor_move_revolutions(SELECT_COARSE_TRICKLER_MOTOR, bulk_charge_rev, coarse_trickler_max_speed);
+    }
+
     while (true) {
-        // Non block waiting for the input
-        ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
-        if (button_encoder_event == BUTTON_RST_PRESSED) {
+        // Run the PID controlled loop to start charging
+        // Every sample is processed in order, as it arrives
+        charge_input_t input = charge_mode_wait_for_input(portMAX_DELAY);
+
+        if (input.type == CHARGE_INPUT_BUTTON && input.button_encoder_event == BUTTON_RST_PRESSED) {
             charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
             return;
         }
-
-        // Run the PID controlled loop to start charging
-        // Perform the measurement
-        float current_weight;
-        if (!scale_block_wait_for_next_measurement(200, &current_weight)) {
-            // If no measurement within 200ms then poll the button and retry
+        else if (input.type != CHARGE_INPUT_SCALE_SAMPLE) {
             continue;
         }
-        current_sample_tick = xTaskGetTickCount();
+
+        const scale_measurement_t & sample = input.sample;
+
+        // Out of the range of the scale or not decoded, end the charge as an overthrow
+        if (sample.is_overload || !isfinite(sample.weight)) {
+            motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, 0);
+            motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
+
+            if (should_coarse_trickler_move) {
+                charge_phase_end(CHARGE_PHASE_COARSE);
+            }
+            charge_phase_end(CHARGE_PHASE_FINE);
+
+            break;
+        }
+
+        float current_weight = sample.weight;
 
         float coarse_trickler_error = coarse_trickler_target_charge_weight - current_weight;
         float fine_trickler_error = charge_mode_config.target_charge_weight - current_weight;
 
+        // Predict the powder that is still falling, or not yet reported by the scale
+        recent_samples.enqueue(sample);
+        float flow_rate = estimate_flow_rate(recent_samples);
+        float in_flight_weight = 0.0f;
+        if (profile_model_data.predictive_stop_enable && !bulk_charge_active) {
+            in_flight_weight = flow_rate * current_model->fine_stop_delay_s;
+        }
+
+        // Measure the weight left to the fine trickler once the coarse trickler powder has landed
+        if (should_learn_coarse_stop && !should_coarse_trickler_move &&
+            (int64_t) (sample.timestamp_us - coarse_stop_time_us) >= COARSE_SETTLE_TIME_US) {
+            update_coarse_stop_threshold(current_model, coarse_stop_threshold, fine_trickler_error);
+            should_learn_coarse_stop = false;
+        }
+
         // Fine & Coarse trickler stop condition
-        if (fine_trickler_error < charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold) {
+        if (fine_trickler_error < charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold + in_flight_weight) {
             // Stop all motors
             motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, 0);
             motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
 
+            // The bulk charge overshot the target, learn the weight per revolution again
+            if (bulk_charge_active) {
+                current_model->coarse_weight_per_rev = 0.0f;
+                profile_model_updated = true;
+            }
+
+            // The fine phase is skipped if the coarse trickler reaches the fine stop window
+            if (should_coarse_trickler_move) {
+                charge_phase_end(CHARGE_PHASE_COARSE);
+            }
+            charge_phase_end(CHARGE_PHASE_FINE);
+
+            // The coarse trickler has overshot into the fine stop window before settling
+            if (should_learn_coarse_stop) {
+                update_coarse_stop_threshold(current_model, coarse_stop_threshold, fine_trickler_error);
+            }
+
+            // Record for the model update once the weight settles
+            charge_stop_recorded = true;
+            charge_stop_weight = current_weight;
+            charge_stop_flow_rate = flow_rate;
+
             break;
         }
 
+        // Wait for the bulk charge to complete and land, the tricklers are held meanwhile
+        else if (bulk_charge_active) {
+            if (bulk_charge_done_time_us == 0) {
+                if (coarse_trickler_error <= 0) {
+                    // Stop a bulk charge that overshoots, the revolutions are estimated from the time at full speed
+                    motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
+                    float elapsed_s = (int64_t) (sample.timestamp_us - bulk_charge_start_time_us) / 1e6f;
+                    bulk_charge_rev = fminf(bulk_charge_rev, elapsed_s * coarse_trickler_max_speed);
+                    bulk_charge_done_time_us = sample.timestamp_us;
+                }
+                else if (!motor_is_moving_revolutions(SELECT_COARSE_TRICKLER_MOTOR)) {
+                    bulk_charge_done_time_us = sample.timestamp_us;
+                }
+            }
+            else if ((int64_t) (sample.timestamp_us - bulk_charge_done_time_us) >= COARSE_SETTLE_TIME_US) {
+                update_coarse_weight_per_rev(current_model, current_weight, bulk_charge_rev);
+                bulk_charge_active = false;
+                recent_samples.reset();
+
+                // The coarse trickler continues with the PID if the bulk charge falls short
+                if (coarse_trickler_error <= 0) {
+                    should_coarse_trickler_move = false;
+                    coarse_stop_time_us = bulk_charge_done_time_us;
+                    charge_phase_end(CHARGE_PHASE_COARSE);
+
+                    if (servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
+                        servo_gate_set_ratio(charge_mode_config.eeprom_charge_mode_data.coarse_stop_gate_ratio, false);
+                    }
+                }
+
+                // Start the PID without the derivative history from before the bulk charge landed
+                coarse_trickler_pid.reset();
+                fine_trickler_pid.reset();
+            }
+
+            last_sample_time_us = sample.timestamp_us;
+            continue;
+        }
+
         // Coarse trickler stop condition
         else if (coarse_trickler_error <= 0 &&
                  should_coarse_trickler_move) {
 
             should_coarse_trickler_move = false;
             motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
+            coarse_stop_time_us = sample.timestamp_us;
+            charge_phase_end(CHARGE_PHASE_COARSE);
+
+            // Only the fine trickler flow is relevant for the stop prediction
+            recent_samples.reset();
 
             // NEW: When the coarse trickler stops, move the servo gate to a configured ratio
             // Ratio convention: 0.0 = open, 1.0 = close
@@ -298,83 +808,90 @@ void charge_mode_wait_for_complete() {
         }
     
 
-        // Update fine trickler speed
-        float elapse_time_ms = (current_sample_tick - last_sample_tick) / portTICK_RATE_MS;
-        fine_trickler_integral += fine_trickler_error;
-        float fine_trickler_derivative = (fine_trickler_error - fine_trickler_last_error) / elapse_time_ms;
+        // Use the arrival time of the samples, frames decoded back to back share the same timestamp
+        float elapse_time_s = (int64_t) (sample.timestamp_us - last_sample_time_us) / 1e6f;
 
-        // Update fine trickler speed
-        float new_p = current_profile->fine_kp * fine_trickler_error;
-        float new_i = current_profile->fine_ki * fine_trickler_integral;
-        float new_d = current_profile->fine_kd * fine_trickler_derivative;
-        float new_speed = fmaxf(fine_trickler_min_speed, fminf(new_p + new_i + new_d, fine_trickler_max_speed));
+        // Update fine trickler speed, the feed-forward aims at the stop point with the in-flight powder taken out
+        float new_ff = get_feed_forward_speed(&current_model->fine_flow_model,
+                                              fine_trickler_error - in_flight_weight,
+                                              current_model->fine_feed_forward_time_s,
+                                              speed_commands.getCounter() ? speed_commands.last().fine_speed_rps : fine_trickler_max_speed);
+        float new_speed = fine_trickler_pid.update(charge_mode_config.target_charge_weight, current_weight,
+                                                   elapse_time_s, new_ff);
         motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, new_speed);
 
+        speed_command_t speed_command = {
+            .timestamp_us = sample.timestamp_us,
+            .coarse_speed_rps = 0.0f,
+            .fine_speed_rps = new_speed,
+        };
+
         // Update coarse trickler speed
         if (should_coarse_trickler_move) {
-            coarse_trickler_integral += coarse_trickler_error;
-            float coarse_trickler_derivative = (coarse_trickler_error - coarse_trickler_last_error) / elapse_time_ms;
-
-            new_p = current_profile->coarse_kp * coarse_trickler_error;
-            new_i = current_profile->coarse_ki * coarse_trickler_integral;
-            new_d = current_profile->coarse_kd * coarse_trickler_derivative ;
+            new_ff = get_feed_forward_speed(&current_model->coarse_flow_model,
+                                            coarse_trickler_error - flow_rate * FLOW_MODEL_DELAY_US / 1e6f,
+                                            current_model->coarse_feed_forward_time_s,
+                                            speed_commands.getCounter() ? speed_commands.last().coarse_speed_rps : coarse_trickler_max_speed);
 
-            new_speed = fmaxf(coarse_trickler_min_speed, fminf(new_p + new_i + new_d, coarse_trickler_max_speed));
+            new_speed = coarse_trickler_pid.update(coarse_trickler_target_charge_weight, current_weight,
+                                                   elapse_time_s, new_ff);
 
             motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, new_speed);
+            speed_command.coarse_speed_rps = new_speed;
         }
 
+        // Relate the measured flow to the commanded speeds
+        record_flow(current_model, speed_commands, recent_samples, flow_rate);
+        speed_commands.enqueue(speed_command);
+
         // Record state
-        last_sample_tick = current_sample_tick;
-        fine_trickler_last_error = fine_trickler_error;
-        coarse_trickler_last_error = coarse_trickler_error;
+        if (elapse_time_s > 0) {
+            last_sample_time_us = sample.timestamp_us;
+        }
     }
 
     // Stop the timer 
     TickType_t now = xTaskGetTickCount();
     TickType_t elapsed_ticks = now - charge_start_tick;
     last_charge_elapsed_seconds = (float)(elapsed_ticks * portTICK_PERIOD_MS) / 1000.0f;
+    charge_complete_time_us = time_us_64();
 
-    // Close the gate if the servo gate is present
+    // Close the gate if the servo gate is present, the precharge waits for the move during the cup removal
     if (servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
-    servo_gate_set_ratio(SERVO_GATE_RATIO_CLOSED, true);
-    }
-
-    // Precharge
-    if (charge_mode_config.eeprom_charge_mode_data.precharge_enable &&
-    servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
-        // Set a fixed delay between closing the gate and precharge to allow the gate to fully close
-        vTaskDelay(pdMS_TO_TICKS(500));
-
-        // Start the pre-charge
-        motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, charge_mode_config.eeprom_charge_mode_data.precharge_speed_rps);
-        vTaskDelay(pdMS_TO_TICKS(charge_mode_config.eeprom_charge_mode_data.precharge_time_ms));
-
-        motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
-    }
-    else {
-        vTaskDelay(pdMS_TO_TICKS(20));  // Wait for other tasks to complete  
+        servo_gate_set_ratio(SERVO_GATE_RATIO_CLOSED, false);
     }
 
     charge_mode_config.charge_mode_state = CHARGE_MODE_WAIT_FOR_CUP_REMOVAL;
 }
 
-void charge_mode_wait_for_cup_removal() {
-    // Update current status
-    snprintf(title_string, sizeof(title_string), "Remove Cup");
 
-    FloatRingBuffer data_buffer(5);
+/*
+    Measure the settled charge, feed the models and report the result by the LEDs and the events.
+*/
+static void charge_mode_report_result(const scale_measurement_t & result) {
+    float current_measurement = result.weight;
+    float error = charge_mode_config.target_charge_weight - current_measurement;
 
-    // Post charge analysis (while waiting for removal of the cup)
-    vTaskDelay(pdMS_TO_TICKS(1000));  // Wait for other tasks to complete
+    // Out of the range of the scale, reported as an over charge with an unknown weight
+    bool is_overload = result.is_overload || !isfinite(current_measurement);
 
-    // Take current measurement
-    float current_measurement = scale_get_current_measurement();
-    float error = charge_mode_config.target_charge_weight - current_measurement;
+    // Log the charge to the batch, the next target is loaded once the cup is off the scale
+    if (charge_batch_is_running()) {
+        charge_batch_record(is_overload ? NAN : current_measurement, last_charge_elapsed_seconds);
+    }
+
+    // Feed the settled weight back to the in-flight model. Skip if the cup is already lifted.
+    if (charge_stop_recorded && !is_overload &&
+        current_measurement >= charge_stop_weight - charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold) {
+        update_fine_stop_delay(profile_get_selected_model(), current_measurement - charge_stop_weight, charge_stop_flow_rate);
+    }
+    charge_stop_recorded = false;
+
+    charge_phase_end(CHARGE_PHASE_SETTLE);
 
     // Update LED colour before moving to the next stage
     // Over charged
-    if (error <= -charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold) {
+    if (is_overload || error <= -charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold) {
         neopixel_led_set_colour(
             neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour,
             charge_mode_config.eeprom_charge_mode_data.neopixel_over_charge_colour, 
@@ -410,36 +927,115 @@ void charge_mode_wait_for_cup_removal() {
         // Clear over and under charge bit
         charge_mode_config.charge_mode_event &= ~(CHARGE_MODE_EVENT_UNDER_CHARGE | CHARGE_MODE_EVENT_OVER_CHARGE);
     }
+}
 
-    // Stop condition: 5 stable measurements in 300ms apart (1.5 seconds minimum)
-    while (true) {
-        TickType_t last_sample_tick = xTaskGetTickCount();
 
-        // Non block waiting for the input
-        ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
-        if (button_encoder_event == BUTTON_RST_PRESSED) {
-            charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
-            return;
+void charge_mode_wait_for_cup_removal() {
+    // Update current status
+    snprintf(title_string, sizeof(title_string), "Remove Cup");
+
+    SettleDetector<16> settle_detector(charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin);
+    settle_detector.setScaleFlagsMotion(scale_config.scale_handle->reports_stability);
+
+    // The post charge steps run along the cup removal detection, each one advances on its own time
+    bool batch_active = charge_batch_is_running();
+    bool result_pending = true;
+    bool precharge_pending = charge_mode_config.eeprom_charge_mode_data.precharge_enable &&
+                             servo_gate.eeprom_servo_gate_config.servo_gate_enable;
+    uint64_t gate_closed_time_us = 0;
+    uint64_t precharge_start_time_us = 0;
+
+    // Stop condition: the reading settles with the cup off the scale, once the post charge steps are done
+    while (true) {
+        uint64_t now_us = time_us_64();
+
+        // Precharge once the gate has closed
+        if (precharge_pending) {
+            if (gate_closed_time_us == 0) {
+                if (servo_gate_is_move_complete()) {
+                    gate_closed_time_us = now_us;
+                }
+            }
+            else if (precharge_start_time_us == 0) {
+                if (now_us - gate_closed_time_us >= PRECHARGE_GATE_SETTLE_TIME_US) {
+                    motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, charge_mode_config.eeprom_charge_mode_data.precharge_speed_rps);
+                    precharge_start_time_us = now_us;
+                }
+            }
+            else if (now_us - precharge_start_time_us >= charge_mode_config.eeprom_charge_mode_data.precharge_time_ms * 1000ull) {
+                motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
+                precharge_pending = false;
+            }
         }
 
-        // Perform measurement
-        float current_weight;
-        if (!scale_block_wait_for_next_measurement(200, &current_weight)) {
-            // If no measurement within 200ms then poll the button and retry
-            continue;
+        // Post charge analysis once the powder has landed and the scale reports the reading as stable,
+        // an overload is not going to settle
+        if (result_pending && now_us - charge_complete_time_us >= POST_CHARGE_SETTLE_TIME_US) {
+            scale_measurement_t latest_sample = scale_get_latest_sample();
+
+            if (latest_sample.is_stable || latest_sample.is_overload ||
+                now_us - charge_complete_time_us >= POST_CHARGE_SETTLE_TIME_US + POST_CHARGE_UNSTABLE_TIMEOUT_US) {
+                charge_mode_report_result(latest_sample);
+                result_pending = false;
+            }
         }
-        data_buffer.enqueue(current_weight);
 
         // Generate stop condition
-        if (data_buffer.getCounter() >= 5) {
-            if (data_buffer.getSd() < charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin && 
-                data_buffer.getMean() + 10 < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin){
-                break;
+        if (!result_pending && !precharge_pending && settle_detector.isStable() &&
+            settle_detector.getMean() + 10 < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin) {
+            break;
+        }
+
+        // Sleep until the next input or the next step of the post charge
+        TickType_t timeout_ticks = portMAX_DELAY;
+        if (result_pending) {
+            uint64_t result_deadline_us = charge_complete_time_us + POST_CHARGE_SETTLE_TIME_US;
+            if (now_us >= result_deadline_us) {
+                // Waiting for a stable frame, the samples wake the loop until the timeout
+                result_deadline_us += POST_CHARGE_UNSTABLE_TIMEOUT_US;
+            }
+            timeout_ticks = ticks_until(result_deadline_us);
+        }
+        if (precharge_pending) {
+            TickType_t precharge_ticks;
+            if (gate_closed_time_us == 0) {
+                precharge_ticks = pdMS_TO_TICKS(GATE_POLL_PERIOD_MS);
+            }
+            else if (precharge_start_time_us == 0) {
+                precharge_ticks = ticks_until(gate_closed_time_us + PRECHARGE_GATE_SETTLE_TIME_US);
+            }
+            else {
+                precharge_ticks = ticks_until(precharge_start_time_us + charge_mode_config.eeprom_charge_mode_data.precharge_time_ms * 1000ull);
+            }
+            if (precharge_ticks < timeout_ticks) {
+                timeout_ticks = precharge_ticks;
             }
         }
 
-        // Wait for next measurement
-        vTaskDelayUntil(&last_sample_tick, pdMS_TO_TICKS(300));
+        charge_input_t input = charge_mode_wait_for_input(timeout_ticks);
+
+        if (input.type == CHARGE_INPUT_BUTTON && input.button_encoder_event == BUTTON_RST_PRESSED) {
+            if (precharge_start_time_us) {
+                motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
+            }
+            charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
+            return;
+        }
+        else if (input.type == CHARGE_INPUT_SCALE_SAMPLE) {
+            // A reading that does not decode counts as the scale still settling
+            settle_detector.update(input.sample.weight, input.sample.timestamp_us, input.sample.is_stable && isfinite(input.sample.weight));
+        }
+    }
+
+    charge_phase_end(CHARGE_PHASE_CUP_REMOVAL);
+
+    // Preload the next batch charge while the cup is away, leave once the batch is complete
+    if (batch_active) {
+        if (!charge_batch_is_running()) {
+            charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
+            return;
+        }
+        charge_batch_load_next();
     }
 
     // Reset LED to default colour
@@ -463,64 +1059,74 @@ void charge_mode_wait_for_cup_return() {
     snprintf(title_string, sizeof(title_string), "Return Cup");
 
 
-    FloatRingBuffer data_buffer(5);
-
+    // Stop condition: the first sample with the cup back on the scale
     while (true) {
-        TickType_t last_sample_tick = xTaskGetTickCount();
+        charge_input_t input = charge_mode_wait_for_input(portMAX_DELAY);
 
-        // Non block waiting for the input
-        ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
-        if (button_encoder_event == BUTTON_RST_PRESSED) {
-            charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
-            return;
-        }
-        else if (button_encoder_event == BUTTON_ENCODER_PRESSED) {
-            scale_config.scale_handle->force_zero();
-        }
-
-        // Perform measurement
-        float current_weight;
-        if (!scale_block_wait_for_next_measurement(200, &current_weight)) {
-            // If no measurement within 200ms then poll the button and retry
-            continue;
+        if (input.type == CHARGE_INPUT_BUTTON) {
+            if (input.button_encoder_event == BUTTON_RST_PRESSED) {
+                charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
+                return;
+            }
+            else if (input.button_encoder_event == BUTTON_ENCODER_PRESSED) {
+                scale_config.scale_handle->force_zero();
+            }
         }
-
-        if (current_weight >= 0) {
+        else if (input.type == CHARGE_INPUT_SCALE_SAMPLE && input.sample.weight >= 0) {
             break;
         }
-
-        // Wait for next measurement
-        vTaskDelayUntil(&last_sample_tick, pdMS_TO_TICKS(20));
     }
 
+    charge_phase_end(CHARGE_PHASE_CUP_RETURN);
+    charge_timing_commit();
+
     charge_mode_config.charge_mode_state = CHARGE_MODE_WAIT_FOR_ZERO;
 }
 
 
+float charge_mode_get_digits_weight(void) {
+    switch (charge_mode_config.eeprom_charge_mode_data.decimal_places) {
+        case DP_2:
+            return charge_weight_digits[4] * 100 + \
+                   charge_weight_digits[3] * 10 + \
+                   charge_weight_digits[2] * 1 + \
+                   charge_weight_digits[1] * 0.1 + \
+                   charge_weight_digits[0] * 0.01;
+        case DP_3:
+            return charge_weight_digits[4] * 10 + \
+                   charge_weight_digits[3] * 1 + \
+                   charge_weight_digits[2] * 0.1 + \
+                   charge_weight_digits[1] * 0.01 + \
+                   charge_weight_digits[0] * 0.001;
+        default:
+            return 0;
+    }
+}
+
+
 uint8_t charge_mode_menu(bool charge_mode_skip_user_input) {
     // Create target weight, if the charge mode weight is built by charge_weight_digits
     if (!charge_mode_skip_user_input) {
-        switch (charge_mode_config.eeprom_charge_mode_data.decimal_places) {
-            case DP_2:
-                charge_mode_config.target_charge_weight = charge_weight_digits[4] * 100 + \
-                                                charge_weight_digits[3] * 10 + \
-                                                charge_weight_digits[2] * 1 + \
-                                                charge_weight_digits[1] * 0.1 + \
-                                                charge_weight_digits[0] * 0.01;
-                break;
-            case DP_3:
-                charge_mode_config.target_charge_weight = charge_weight_digits[4] * 10 + \
-                                                charge_weight_digits[3] * 1 + \
-                                                charge_weight_digits[2] * 0.1 + \
-                                                charge_weight_digits[1] * 0.01 + \
-                                                charge_weight_digits[0] * 0.001;
-                break;
-            default:
-                charge_mode_config.target_charge_weight = 0;
-                break;
+        charge_mode_config.target_charge_weight = charge_mode_get_digits_weight();
+    }
+
+    // The batch overrides the target and the profile
+    charge_batch_load_next();
+
+    // Subscribe to the scale on the first entry, the samples received while away are dropped on attach
+    if (charge_mode_scale_subscriber == NULL) {
+        charge_mode_scale_subscriber = scale_subscribe(CHARGE_MODE_SUBSCRIBER_DEPTH);
+        if (charge_mode_scale_subscriber == NULL) {
+            return 1;  // return back to main menu
         }
     }
 
+    if (!charge_mode_attach_inputs()) {
+        printf("Unable to attach the charge mode inputs\n");
+        charge_mode_detach_inputs();
+        return 1;  // return back to main menu
+    }
+
     // If the display task is never created then we shall create one, otherwise we shall resume the task
     if (scale_measurement_render_task_handler == NULL) {
         // The render task shall have lower priority than the current one
@@ -565,6 +1171,11 @@ uint8_t charge_mode_menu(bool charge_mode_skip_user_input) {
                             neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led2_colour,
                             true);
 
+    // Keep the batch position, a restart resumes from the next charge
+    charge_batch_pause();
+
+    charge_mode_detach_inputs();
+
     // vTaskDelete(scale_measurement_render_handler);
     vTaskSuspend(scale_measurement_render_task_handler);
 
@@ -572,6 +1183,12 @@ uint8_t charge_mode_menu(bool charge_mode_skip_user_input) {
     motor_enable(SELECT_COARSE_TRICKLER_MOTOR, false);
     motor_enable(SELECT_FINE_TRICKLER_MOTOR, false);
 
+    // Persist the learned models once per session to limit the EEPROM wear
+    if (profile_model_updated) {
+        profile_model_save();
+        profile_model_updated = false;
+    }
+
     return 1;  // return back to main menu
 }
 
@@ -792,3 +1409,61 @@ bool http_rest_charge_mode_state(struct fs_file *file, int num_params, char *par
 
     return true;
 }
+
+
+bool http_rest_charge_timing(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings:
+    // n (int): number of charges in the history
+    // t0 (array): zero wait time in ms, as [last, mean, min, max]
+    // t1 (array): coarse trickler time in ms
+    // t2 (array): fine trickler time in ms
+    // t3 (array): settle time in ms, from the fine trickler stop to the post charge measurement
+    // t4 (array): cup removal time in ms
+    // t5 (array): cup return time in ms
+    // rs (bool): clear the history
+
+    static char charge_timing_json_buffer[512];
+
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "rs") == 0 && string_to_boolean(values[idx])) {
+            for (int phase = 0; phase < CHARGE_PHASE_CNT; phase += 1) {
+                charge_phase_history[phase].reset();
+            }
+        }
+    }
+
+    int len = snprintf(charge_timing_json_buffer,
+                       sizeof(charge_timing_json_buffer),
+                       "%s"
+                       "{\"n\":%u",
+                       http_json_header,
+                       (unsigned) charge_phase_history[0].getCounter());
+
+    for (int phase = 0; phase < CHARGE_PHASE_CNT; phase += 1) {
+        StatisticRingBuffer<int32_t, CHARGE_TIMING_HISTORY_LEN> & history = charge_phase_history[phase];
+
+        if (history.getCounter() == 0) {
+            len += snprintf(charge_timing_json_buffer + len, sizeof(charge_timing_json_buffer) - len,
+                            ",\"t%d\":[]", phase);
+        }
+        else {
+            len += snprintf(charge_timing_json_buffer + len, sizeof(charge_timing_json_buffer) - len,
+                            ",\"t%d\":[%0.1f,%0.1f,%0.1f,%0.1f]",
+                            phase,
+                            history.last() / 1000.0f,
+                            history.getMean() / 1000.0f,
+                            history.getMin() / 1000.0f,
+                            history.getMax() / 1000.0f);
+        }
+    }
+
+    snprintf(charge_timing_json_buffer + len, sizeof(charge_timing_json_buffer) - len, "}");
+
+    size_t data_length = strlen(charge_timing_json_buffer);
+    file->data = charge_timing_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
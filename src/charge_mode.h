@@ -11,6 +11,9 @@
 
 #define WEIGHT_STRING_LEN 8
 
+// Number of completed charges kept for the timing statistics
+#define CHARGE_TIMING_HISTORY_LEN   16
+
 typedef enum {
     CHARGE_MODE_EXIT = 0,
     CHARGE_MODE_WAIT_FOR_ZERO = 1,
@@ -19,6 +22,17 @@ typedef enum {
     CHARGE_MODE_WAIT_FOR_CUP_RETURN = 4,
 } charge_mode_state_t;
 
+// Phases of a charge cycle, in the order they run
+typedef enum {
+    CHARGE_PHASE_ZERO_WAIT = 0,
+    CHARGE_PHASE_COARSE = 1,
+    CHARGE_PHASE_FINE = 2,
+    CHARGE_PHASE_SETTLE = 3,                    // Fine trickler stop to the post charge measurement
+    CHARGE_PHASE_CUP_REMOVAL = 4,
+    CHARGE_PHASE_CUP_RETURN = 5,
+    CHARGE_PHASE_CNT,
+} charge_phase_t;
+
 typedef struct {
     uint16_t charge_mode_data_rev;
 
@@ -60,11 +74,13 @@ extern "C" {
 
 bool charge_mode_config_init(void);
 uint8_t charge_mode_menu(bool charge_mode_skip_user_input);
+float charge_mode_get_digits_weight(void);     // Charge weight entered in the menu
 bool charge_mode_config_save(void);
 
 // REST interface
 bool http_rest_charge_mode_config(struct fs_file *file, int num_params, char *params[], char *values[]);
 bool http_rest_charge_mode_state(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_charge_timing(struct fs_file *file, int num_params, char *params[], char *values[]);
 
 
 #ifdef __cplusplus
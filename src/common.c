@@ -183,6 +183,37 @@ bool load_config(uint16_t addr, void * cfg, const void * default_cfg, size_t siz
 }
 
 
+bool read_config(uint16_t addr, void * cfg, size_t size) {
+    uint32_t received_crc32;
+    uint16_t received_rev;
+
+    size_t read_size = size + sizeof(received_crc32);
+    uint8_t * buf = malloc(read_size);
+
+    if (!buf) {
+        printf("Unable to allocate buffer with size: %d\n", read_size);
+        return false;
+    }
+
+    bool is_ok = eeprom_read(addr, buf, read_size);
+
+    if (is_ok) {
+        memcpy(&received_rev, buf, sizeof(received_rev));
+        memcpy(&received_crc32, buf + size, sizeof(received_crc32));
+
+        // Same validation as load_config
+        is_ok = received_rev == 0 && software_crc32(buf, size) == received_crc32;
+    }
+
+    if (is_ok) {
+        memcpy(cfg, buf, size);
+    }
+    free(buf);
+
+    return is_ok;
+}
+
+
 bool save_config(uint16_t addr, void * cfg, size_t size) {
     bool is_ok;
     uint32_t calculated_crc32;
@@ -40,6 +40,12 @@ int float_to_string(char * output_decimal_str, float var, decimal_places_t decim
  */
 bool load_config(uint16_t addr, void * cfg, const void * default_cfg, size_t size, uint16_t rev_validation);
 
+/**
+ * @brief Read a configuration saved with the given size. Returns false if the CRC32 does not match, 
+ *  cfg and the storage are left untouched. Used to find out the layout of a configuration to migrate.
+ */
+bool read_config(uint16_t addr, void * cfg, size_t size);
+
 /**
  * @brief Save configuration to persistent storage
  */
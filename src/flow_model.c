@@ -0,0 +1,62 @@
+#include <string.h>
+#include <math.h>
+
+#include "flow_model.h"
+
+
+// The first samples of a bin are averaged, later samples are weighted by the learning rate
+#define FLOW_MODEL_LEARNING_RATE        0.05f
+
+
+static const float flow_model_speed_bin_edges[FLOW_MODEL_SPEED_BIN_CNT - 1] = FLOW_MODEL_SPEED_BIN_EDGES;
+
+
+uint8_t flow_model_get_bin(float speed_rps) {
+    uint8_t bin = 0;
+    while (bin < FLOW_MODEL_SPEED_BIN_CNT - 1 && speed_rps >= flow_model_speed_bin_edges[bin]) {
+        bin += 1;
+    }
+
+    return bin;
+}
+
+
+void flow_model_update(flow_model_t * model, float speed_rps, float weight_per_rev) {
+    if (speed_rps <= 0 || weight_per_rev <= 0) {
+        return;
+    }
+
+    uint8_t bin = flow_model_get_bin(speed_rps);
+
+    if (model->sample_cnt[bin] < UINT16_MAX) {
+        model->sample_cnt[bin] += 1;
+    }
+
+    float learning_rate = fmaxf(FLOW_MODEL_LEARNING_RATE, 1.0f / model->sample_cnt[bin]);
+    model->weight_per_rev[bin] += learning_rate * (weight_per_rev - model->weight_per_rev[bin]);
+}
+
+
+/*
+    Weight per revolution at the speed, taken from the closest learned bin. Returns 0 if nothing
+    is learned yet.
+*/
+float flow_model_get_weight_per_rev(const flow_model_t * model, float speed_rps) {
+    int bin = flow_model_get_bin(speed_rps);
+
+    for (int distance = 0; distance < FLOW_MODEL_SPEED_BIN_CNT; distance += 1) {
+        if (bin - distance >= 0 && model->sample_cnt[bin - distance] > 0) {
+            return model->weight_per_rev[bin - distance];
+        }
+        if (bin + distance < FLOW_MODEL_SPEED_BIN_CNT && model->sample_cnt[bin + distance] > 0) {
+            return model->weight_per_rev[bin + distance];
+        }
+    }
+
+    return 0.0f;
+}
+
+
+void flow_model_reset(flow_model_t * model) {
+    memset(model, 0x0, sizeof(flow_model_t));
+}
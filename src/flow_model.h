@@ -0,0 +1,34 @@
+#ifndef FLOW_MODEL_H_
+#define FLOW_MODEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// Speed bins of the flow model, in rev/s of the trickler. Bin n covers the speed from the upper
+// edge of bin n - 1 to the upper edge of bin n, the last bin has no upper limit.
+#define FLOW_MODEL_SPEED_BIN_CNT        6
+#define FLOW_MODEL_SPEED_BIN_EDGES      {0.1f, 0.2f, 0.5f, 1.0f, 2.0f}
+
+
+// Weight delivered per revolution of a trickler, learned in each speed bin
+typedef struct {
+    float weight_per_rev[FLOW_MODEL_SPEED_BIN_CNT];     // 0 if not learned
+    uint16_t sample_cnt[FLOW_MODEL_SPEED_BIN_CNT];
+} flow_model_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint8_t flow_model_get_bin(float speed_rps);
+void flow_model_update(flow_model_t * model, float speed_rps, float weight_per_rev);
+float flow_model_get_weight_per_rev(const flow_model_t * model, float speed_rps);
+void flow_model_reset(flow_model_t * model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FLOW_MODEL_H_
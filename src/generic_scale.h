@@ -1,7 +0,0 @@
-#ifndef GENERIC_SCALE_H_
-#define GENERIC_SCALE_H_
-
-
-
-
-#endif  // GENERIC_SCALE_H_
\ No newline at end of file
@@ -14,6 +14,8 @@
 #include "eeprom.h"
 #include "charge_mode.h"
 #include "cleanup_mode.h"
+#include "autotune_mode.h"
+#include "charge_batch.h"
 #include "eeprom.h"
 #include "wireless.h"
 #include "system_control.h"
@@ -75,6 +77,12 @@ void menu_task(void *p){
                 case APP_STATE_ENTER_CLEANUP_MODE:
                     exit_form_id = cleanup_mode_menu();
                     break;
+                case APP_STATE_ENTER_AUTOTUNE_MODE:
+                    exit_form_id = autotune_mode_menu();
+                    break;
+                case APP_STATE_ENTER_BATCH_MODE:
+                    exit_form_id = charge_batch_menu();
+                    break;
                 case APP_STATE_ENTER_SCALE_CALIBRATION:
                     exit_form_id = scale_calibrate_with_external_weight();
                     break;
@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "motor_period.h"
+
+
+static uint32_t full_cycle_to_period(uint32_t full_cycle_count, uint32_t max_full_cycle_count) {
+    // Limit by maximum response time
+    if (full_cycle_count > max_full_cycle_count) {
+        full_cycle_count = 0;
+    }
+
+    // Avoid wrap around
+    if (full_cycle_count < STEPPER_LOW_CYCLE_COUNT) {
+        full_cycle_count = STEPPER_LOW_CYCLE_COUNT;
+    }
+
+    // High cycle should be calculated as full_cycle - low cycle.
+    return full_cycle_count - STEPPER_LOW_CYCLE_COUNT;
+}
+
+
+/*
+    Reference conversion in floating point. The RP2040 has no FPU so this runs in soft-float, use
+    speed_mrps_to_period() on the motor control path.
+*/
+uint32_t speed_to_period(float speed, uint32_t pio_clock_speed, uint32_t full_rotation_steps) {
+    // speed: rev/s
+    float step_speed = full_rotation_steps * speed;    // in steps/s
+
+    uint32_t full_cycle_count = lroundf(pio_clock_speed / step_speed);
+
+    return full_cycle_to_period(full_cycle_count, pio_clock_speed * MAX_RESPONSE_TIME);
+}
+
+
+/*
+    Derive the integer scale for the given PIO clock and steps per rotation. Returns false if the
+    configuration does not fit the 32 bit scale, in which case the scale is saturated.
+*/
+bool motor_period_scale_update(motor_period_scale_t * scale, uint32_t pio_clock_speed, uint32_t full_rotation_steps) {
+    scale->pio_clock_speed = pio_clock_speed;
+    scale->full_rotation_steps = full_rotation_steps;
+    scale->max_full_cycle_count = (uint32_t) (pio_clock_speed * MAX_RESPONSE_TIME);
+
+    if (full_rotation_steps == 0) {
+        scale->cycles_per_milli_rev = 0;
+        return false;
+    }
+
+    uint64_t cycles_per_milli_rev = ((uint64_t) pio_clock_speed * 1000 + full_rotation_steps / 2) / full_rotation_steps;
+    if (cycles_per_milli_rev > UINT32_MAX) {
+        scale->cycles_per_milli_rev = UINT32_MAX;
+        return false;
+    }
+
+    scale->cycles_per_milli_rev = (uint32_t) cycles_per_milli_rev;
+    return true;
+}
+
+
+/*
+    Integer conversion from the speed in milli-rev/s to the PIO high cycle count. One 32 bit division,
+    done by the RP2040 hardware divider. Speed 0 returns 0, which stops the PIO stepper.
+*/
+uint32_t speed_mrps_to_period(const motor_period_scale_t * scale, uint32_t speed_mrps) {
+    if (speed_mrps == 0) {
+        return 0;
+    }
+
+    // Round to nearest without overflowing a saturated scale
+    uint32_t full_cycle_count = scale->cycles_per_milli_rev / speed_mrps;
+    uint32_t remainder = scale->cycles_per_milli_rev - full_cycle_count * speed_mrps;
+    if (remainder >= speed_mrps - remainder) {
+        full_cycle_count += 1;
+    }
+
+    return full_cycle_to_period(full_cycle_count, scale->max_full_cycle_count);
+}
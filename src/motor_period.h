@@ -0,0 +1,35 @@
+#ifndef MOTOR_PERIOD_H_
+#define MOTOR_PERIOD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STEPPER_LOW_CYCLE_COUNT     13      // Defined as the implementation of stepper.pio
+#define MAX_RESPONSE_TIME           0.01f   // Maximum response time for PIO stepper
+
+
+// Integer scale for the speed to PIO period conversion, derived from the PIO clock and the steps
+// per rotation. Regenerate with motor_period_scale_update() when either of them changes.
+typedef struct {
+    uint32_t pio_clock_speed;
+    uint32_t full_rotation_steps;
+
+    uint32_t cycles_per_milli_rev;          // PIO cycles per step at 1 milli-rev/s
+    uint32_t max_full_cycle_count;          // Slower than this is treated as stopped
+} motor_period_scale_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t speed_to_period(float speed, uint32_t pio_clock_speed, uint32_t full_rotation_steps);
+
+bool motor_period_scale_update(motor_period_scale_t * scale, uint32_t pio_clock_speed, uint32_t full_rotation_steps);
+uint32_t speed_mrps_to_period(const motor_period_scale_t * scale, uint32_t speed_mrps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MOTOR_PERIOD_H_
@@ -1,6 +1,7 @@
 /* Isolate the C and C++ */
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <FreeRTOS.h>
 #include <queue.h>
@@ -15,20 +16,21 @@
 #include "stepper.pio.h"
 
 #include "motors.h"
+#include "motor_period.h"
 #include "eeprom.h"
 #include "common.h"
 #include "display.h"  // in case the stepper motor driver failed to initialize
 #include "neopixel_led.h" // in case the stepper motor driver failed to initialize
 
-#define STEPPER_LOW_CYCLE_COUNT 13  // Defined as the implementation of stepper.pio
-#define MAX_RESPONSE_TIME   0.01f   // Maximum response time for PIO stepper
+#define MOTOR_RAMP_MIN_STEP_US  1000    // Shortest time between two speed steps of a ramp
 
 
-// Internal data structure for speed control between tasks
+// Request to the stepper speed control task. A counted move makes the given revolutions at the
+// velocity then stops, otherwise the motor ramps to the velocity.
 typedef struct {
-    float new_speed_setpoint;
-    float direction;
-    float ramp_rate;
+    float velocity;
+    float revolutions;
+    uint32_t counted_move_seq;          // Latest counted move requested when the request is made
 } stepper_speed_control_t;
 
 
@@ -51,6 +53,9 @@ const eeprom_motor_data_t default_motor_data = {
         .min_speed_rps = 0.08,              // Minimum speed for powder to drop, can be overridden by the profile
         .gear_ratio = 1.25f,                // 40:32 gear ratio for coarse trickler motor
 
+        .ramp_profile = MOTOR_RAMP_LINEAR,  // Linear or S-curve acceleration ramp
+        .angular_jerk = 1000,               // In rev/s^3, the S-curve reaches the full acceleration in 50 ms
+
         .inverted_direction = false,        // Invert the rotation direction if set to true
         .inverted_enable = false,           // Invert the enable flag if set to true
     },
@@ -65,12 +70,37 @@ const eeprom_motor_data_t default_motor_data = {
         .min_speed_rps = 0.01,              // Minimum speed for powder to drop, can be overridden by the profile
         .gear_ratio = 1.818f,               // Fine trickler gear ratio
 
+        .ramp_profile = MOTOR_RAMP_LINEAR,  // Linear or S-curve acceleration ramp
+        .angular_jerk = 1000,               // In rev/s^3, the S-curve reaches the full acceleration in 50 ms
+
         .inverted_direction = false,        // Invert the rotation direction if set to true
         .inverted_enable = false,           // Invert the enable flag if set to true
     },
 };
 
 
+// Layout saved before the acceleration ramp profile was added, migrated on the first boot
+typedef struct {
+    uint32_t full_steps_per_rotation;
+    uint16_t current_ma;
+    uint16_t microsteps;
+    uint16_t max_speed_rps;
+    uint16_t r_sense;
+
+    float angular_acceleration;
+    float min_speed_rps;
+    float gear_ratio;
+
+    bool inverted_direction;
+    bool inverted_enable;
+} motor_persistent_config_rev1_t;
+
+typedef struct {
+    uint32_t motor_data_rev;
+    motor_persistent_config_rev1_t motor_data[2];
+} eeprom_motor_data_rev1_t;
+
+
 // UART Control functions
 void _enable_uart_rx(uart_inst_t * uart, bool enable) {
     if (enable) {
@@ -176,30 +206,6 @@ TMC_uart_write_datagram_t *tmc_uart_read (trinamic_motor_t driver, TMC_uart_read
     return &wdgr;
 }
 
-uint32_t speed_to_period(float speed, uint32_t pio_clock_speed, uint32_t full_rotation_steps) {
-    // speed: rev/s
-    float step_speed = full_rotation_steps * speed;    // in steps/s
-
-    uint32_t full_cycle_count = lroundf(pio_clock_speed / step_speed);
-
-    // Limit by maximum response time
-    uint32_t max_response_steps = pio_clock_speed * MAX_RESPONSE_TIME;
-    if (full_cycle_count > max_response_steps){ 
-        full_cycle_count = 0;
-    }
-
-    // Avoid wrap around
-    if (full_cycle_count < STEPPER_LOW_CYCLE_COUNT) {
-        full_cycle_count = STEPPER_LOW_CYCLE_COUNT;
-    }
-
-    // High cycle should be calculated as full_cycle - low cycle.
-    uint32_t high_cycle_steps = full_cycle_count - STEPPER_LOW_CYCLE_COUNT;
-
-    return high_cycle_steps;
-}
-
-
 bool tmc2209_init (TMC2209_t *driver)
 {
     // Perform a status register read/write to clear status flags.
@@ -320,6 +326,16 @@ bool driver_pio_init(motor_config_t * motor_config) {
         return false;
     }
 
+    // The step counting program is shared by both motors
+    static int count_offset = -1;
+    if (count_offset < 0) {
+        count_offset = pio_add_program(pio, &stepper_count_program);
+        if (count_offset < 0) {
+            printf("Unable to add program, err: %d\n", count_offset);
+            return false;
+        }
+    }
+
     // is_ok = pio_claim_free_sm_and_add_program_for_gpio_range(
     //     &stepper_program, 
     //     &pio, 
@@ -343,11 +359,47 @@ bool driver_pio_init(motor_config_t * motor_config) {
     // Record the PIO configuration
     motor_config->pio_config.pio = pio;
     motor_config->pio_config.sm = sm;
+    motor_config->stepper_program_offset = offset;
+    motor_config->stepper_count_program_offset = count_offset;
 
     return true;
 }
 
 
+/*
+    Keep the settings saved in the previous layout, the ramp profile fields take the defaults.
+    Returns false if the configuration was not saved in the previous layout.
+*/
+static bool motor_config_migrate_rev1(eeprom_motor_data_t * eeprom_motor_data) {
+    eeprom_motor_data_rev1_t eeprom_motor_data_rev1;
+    if (!read_config(EEPROM_MOTOR_CONFIG_BASE_ADDR, &eeprom_motor_data_rev1, sizeof(eeprom_motor_data_rev1))) {
+        return false;
+    }
+
+    memcpy(eeprom_motor_data, &default_motor_data, sizeof(eeprom_motor_data_t));
+
+    for (int idx = 0; idx < 2; idx += 1) {
+        const motor_persistent_config_rev1_t * saved = &eeprom_motor_data_rev1.motor_data[idx];
+        motor_persistent_config_t * migrated = &eeprom_motor_data->motor_data[idx];
+
+        migrated->full_steps_per_rotation = saved->full_steps_per_rotation;
+        migrated->current_ma = saved->current_ma;
+        migrated->microsteps = saved->microsteps;
+        migrated->max_speed_rps = saved->max_speed_rps;
+        migrated->r_sense = saved->r_sense;
+        migrated->angular_acceleration = saved->angular_acceleration;
+        migrated->min_speed_rps = saved->min_speed_rps;
+        migrated->gear_ratio = saved->gear_ratio;
+        migrated->inverted_direction = saved->inverted_direction;
+        migrated->inverted_enable = saved->inverted_enable;
+    }
+
+    printf("Motor configuration migrated to layout rev %d\n", EEPROM_MOTOR_DATA_LAYOUT_REV);
+
+    return save_config(EEPROM_MOTOR_CONFIG_BASE_ADDR, eeprom_motor_data, sizeof(eeprom_motor_data_t));
+}
+
+
 bool motor_config_init(void) {
     bool is_ok = true;
 
@@ -357,7 +409,18 @@ bool motor_config_init(void) {
     // Read motor config from EEPROM
     eeprom_motor_data_t eeprom_motor_data;
     memset(&eeprom_motor_data, 0x0, sizeof(eeprom_motor_data));
-    is_ok = load_config(EEPROM_MOTOR_CONFIG_BASE_ADDR, &eeprom_motor_data, &default_motor_data, sizeof(eeprom_motor_data), EEPROM_MOTOR_DATA_REV);
+
+    // The layout is told apart by the CRC32, which covers the size of the saved configuration
+    if (read_config(EEPROM_MOTOR_CONFIG_BASE_ADDR, &eeprom_motor_data, sizeof(eeprom_motor_data))) {
+        is_ok = true;
+    }
+    else if (motor_config_migrate_rev1(&eeprom_motor_data)) {
+        is_ok = true;
+    }
+    else {
+        is_ok = load_config(EEPROM_MOTOR_CONFIG_BASE_ADDR, &eeprom_motor_data, &default_motor_data, sizeof(eeprom_motor_data), EEPROM_MOTOR_DATA_REV);
+    }
+
     if (!is_ok) {
         printf("Unable to read motor configuration\n");
         return is_ok;
@@ -395,99 +458,376 @@ bool motor_config_save() {
 }
 
 
-void speed_ramp(motor_config_t * motor_config, float prev_speed, float new_speed, uint32_t pio_speed) {
-    // Calculate ramp param
-    float dv = new_speed - prev_speed;
-    float ramp_time_s = fabs(dv / motor_config->persistent_config.angular_acceleration);
+static void apply_ramp_step(motor_config_t * motor_config, const motor_ramp_step_t * step) {
+    if (step->step_direction != motor_config->step_direction) {
+        motor_config->step_direction = step->step_direction;
+        gpio_put(motor_config->dir_pin, motor_config->step_direction);
+    }
+
+    pio_sm_clear_fifos(motor_config->pio_config.pio, motor_config->pio_config.sm);
+    pio_sm_put(motor_config->pio_config.pio, motor_config->pio_config.sm, step->period);
+
+    motor_config->current_velocity_mrps = step->velocity_mrps;
+}
+
+
+/*
+    Runs in the timer interrupt and outputs the next step of the ramp. Returns false to stop the
+    timer after the last step.
+*/
+static bool ramp_timer_callback(repeating_timer_t * rt) {
+    motor_config_t * motor_config = (motor_config_t *) rt->user_data;
+
+    apply_ramp_step(motor_config, &motor_config->ramp_steps[motor_config->ramp_step_idx]);
+    motor_config->ramp_step_idx += 1;
+
+    return motor_config->ramp_step_idx < motor_config->ramp_step_cnt;
+}
+
+
+/*
+    Jerk limited ramp for a velocity change of dv (rev/s, magnitude). The acceleration rises at the jerk
+    limit, holds at the acceleration limit and falls at the jerk limit again. Short ramps that cannot
+    reach the acceleration limit peak at a lower acceleration instead.
+*/
+typedef struct {
+    float dv;
+    float jerk;
+    float peak_acceleration;
+    float jerk_time_s;          // Duration of each of the jerk phases
+    float total_time_s;
+} s_curve_t;
+
+
+static void s_curve_init(s_curve_t * s_curve, float dv, float acceleration, float jerk) {
+    s_curve->dv = dv;
+    s_curve->jerk = jerk;
+    s_curve->peak_acceleration = fminf(acceleration, sqrtf(dv * jerk));
+    s_curve->jerk_time_s = s_curve->peak_acceleration / jerk;
+    s_curve->total_time_s = s_curve->jerk_time_s + dv / s_curve->peak_acceleration;
+}
+
+
+// Share of the velocity change reached at time t_s of the ramp, from 0 to 1
+static float s_curve_fraction(const s_curve_t * s_curve, float t_s) {
+    float dv_reached;
+
+    if (t_s >= s_curve->total_time_s) {
+        return 1.0f;
+    }
+    else if (t_s < s_curve->jerk_time_s) {
+        dv_reached = 0.5f * s_curve->jerk * t_s * t_s;
+    }
+    else if (t_s < s_curve->total_time_s - s_curve->jerk_time_s) {
+        dv_reached = 0.5f * s_curve->jerk * s_curve->jerk_time_s * s_curve->jerk_time_s + 
+                     s_curve->peak_acceleration * (t_s - s_curve->jerk_time_s);
+    }
+    else {
+        float t_remaining = s_curve->total_time_s - t_s;
+        dv_reached = s_curve->dv - 0.5f * s_curve->jerk * t_remaining * t_remaining;
+    }
+
+    return dv_reached / s_curve->dv;
+}
+
+
+/*
+    Regenerate the period scale if the steps per rotation or the system clock has changed.
+*/
+static uint32_t update_period_scale(motor_config_t * motor_config, uint32_t pio_speed) {
     uint32_t full_rotation_steps = motor_config->persistent_config.full_steps_per_rotation * motor_config->persistent_config.microsteps;
+    if (pio_speed != motor_config->period_scale.pio_clock_speed || 
+        full_rotation_steps != motor_config->period_scale.full_rotation_steps) {
+        if (!motor_period_scale_update(&motor_config->period_scale, pio_speed, full_rotation_steps)) {
+            printf("Unable to derive the step period for %lu steps per rotation\n", (unsigned long) full_rotation_steps);
+        }
+    }
 
-    // Calculate termination condition
-    uint32_t ramp_time_us = (uint32_t) (fabs(ramp_time_s) * 1e6);
-    uint32_t start_time = time_us_32();
-    uint32_t stop_time = start_time + ramp_time_us;
+    return full_rotation_steps;
+}
 
-    float current_speed;
-    uint32_t current_period;
-    while (true) {
-        uint32_t current_time = time_us_32();
-        if (current_time > stop_time) {
-            break;
+
+/*
+    Swap the state machine back to the continuous stepper program after a counted move. A counted
+    move still in progress stops immediately.
+*/
+static void end_counted_move(motor_config_t * motor_config) {
+    if (!motor_config->counted_move_active) {
+        return;
+    }
+
+    PIO pio = motor_config->pio_config.pio;
+    uint sm = motor_config->pio_config.sm;
+
+    pio_sm_set_enabled(pio, sm, false);
+    stepper_program_init(pio, sm, motor_config->stepper_program_offset, motor_config->step_pin);
+    pio_sm_set_enabled(pio, sm, true);
+    pio_interrupt_clear(pio, sm);
+
+    motor_config->counted_move_active = false;
+    motor_config->current_velocity_mrps = 0;
+}
+
+
+/*
+    Fill the ramp table from the start velocity to the new velocity, following the ramp profile of the motor.
+    Returns the duration of the ramp.
+*/
+static uint32_t build_ramp(motor_config_t * motor_config, int32_t start_velocity_mrps, int32_t new_velocity_mrps) {
+    // The ramp is calculated in milli-rev/s so the table is built with integer arithmetic only
+    int32_t dv_mrps = new_velocity_mrps - start_velocity_mrps;
+
+    // A ramp in progress is replaced from zero acceleration
+    float acceleration = motor_config->persistent_config.angular_acceleration;
+    float jerk = motor_config->persistent_config.angular_jerk;
+    bool is_s_curve = motor_config->persistent_config.ramp_profile == MOTOR_RAMP_S_CURVE && jerk > 0 && dv_mrps != 0;
+
+    s_curve_t s_curve;
+    uint32_t ramp_time_us;
+    if (is_s_curve) {
+        s_curve_init(&s_curve, abs(dv_mrps) / 1000.0f, acceleration, jerk);
+        ramp_time_us = (uint32_t) (s_curve.total_time_s * 1e6f);
+    }
+    else {
+        ramp_time_us = (uint32_t) (abs(dv_mrps) * 1000.0f / acceleration);
+    }
+
+    // Split the ramp into steps of at least MOTOR_RAMP_MIN_STEP_US
+    uint32_t step_cnt = ramp_time_us / MOTOR_RAMP_MIN_STEP_US;
+    if (step_cnt > MOTOR_RAMP_TABLE_LEN) {
+        step_cnt = MOTOR_RAMP_TABLE_LEN;
+    }
+    else if (step_cnt == 0) {
+        step_cnt = 1;
+    }
+
+    for (uint32_t idx = 0; idx < step_cnt; idx += 1) {
+        motor_ramp_step_t * step = &motor_config->ramp_steps[idx];
+
+        if (is_s_curve) {
+            float fraction = s_curve_fraction(&s_curve, s_curve.total_time_s * (idx + 1) / step_cnt);
+            step->velocity_mrps = start_velocity_mrps + (int32_t) lroundf(dv_mrps * fraction);
+        }
+        else {
+            step->velocity_mrps = start_velocity_mrps + dv_mrps * (int32_t) (idx + 1) / (int32_t) step_cnt;
         }
+        step->period = speed_mrps_to_period(&motor_config->period_scale, abs(step->velocity_mrps));
+        step->step_direction = motor_config->persistent_config.inverted_direction != (step->velocity_mrps < 0);
+    }
+    motor_config->ramp_step_cnt = step_cnt;
 
-        float percentage = (current_time - start_time) / (float) ramp_time_us;
+    return ramp_time_us;
+}
 
-        current_speed = prev_speed + dv * percentage;
-        current_period = speed_to_period(current_speed, pio_speed, full_rotation_steps);
-        pio_sm_clear_fifos(motor_config->pio_config.pio, motor_config->pio_config.sm);
-        pio_sm_put(motor_config->pio_config.pio, motor_config->pio_config.sm, current_period);
+
+/*
+    Feed the ramp table from the given step to the PIO at the evenly spaced interval, the step before is
+    already output.
+*/
+static void start_ramp_timer(motor_config_t * motor_config, uint8_t first_step_idx, uint32_t ramp_time_us) {
+    uint8_t step_cnt = motor_config->ramp_step_cnt;
+    motor_config->ramp_step_idx = first_step_idx;
+
+    if (first_step_idx < step_cnt) {
+        bool is_ok = add_repeating_timer_us(-(int64_t) (ramp_time_us / step_cnt), ramp_timer_callback, motor_config, &motor_config->ramp_timer);
+
+        // Jump to the new speed if no timer is available
+        if (!is_ok) {
+            printf("Unable to start the ramp timer\n");
+            apply_ramp_step(motor_config, &motor_config->ramp_steps[step_cnt - 1]);
+        }
     }
+}
 
-    current_period = speed_to_period(new_speed, pio_speed, full_rotation_steps);
-    pio_sm_clear_fifos(motor_config->pio_config.pio, motor_config->pio_config.sm);
-    pio_sm_put_blocking(motor_config->pio_config.pio, motor_config->pio_config.sm, current_period);
+
+/*
+    Make the given revolutions at the velocity then stop. The move accelerates from standstill at
+    the acceleration of the motor and the steps are counted by the PIO, the ramp included, so the
+    move completes on its own.
+*/
+static void counted_move(motor_config_t * motor_config, float velocity, float revolutions, uint32_t pio_speed) {
+    PIO pio = motor_config->pio_config.pio;
+    uint sm = motor_config->pio_config.sm;
+
+    // Stop the ramp or the counted move in progress
+    cancel_repeating_timer(&motor_config->ramp_timer);
+    end_counted_move(motor_config);
+
+    uint32_t full_rotation_steps = update_period_scale(motor_config, pio_speed);
+    uint32_t step_cnt = (uint32_t) lroundf(revolutions * full_rotation_steps);
+    int32_t velocity_mrps = (int32_t) lroundf(velocity * 1000);
+
+    // The counting program steps on every period, the ramp starts from the first speed with a period
+    uint32_t ramp_time_us = build_ramp(motor_config, 0, velocity_mrps);
+    uint8_t first_step_idx = 0;
+    while (first_step_idx < motor_config->ramp_step_cnt && motor_config->ramp_steps[first_step_idx].period == 0) {
+        first_step_idx += 1;
+    }
+
+    if (step_cnt == 0 || first_step_idx == motor_config->ramp_step_cnt) {
+        motor_config->current_velocity_mrps = 0;
+        pio_sm_clear_fifos(pio, sm);
+        pio_sm_put(pio, sm, 0);
+        return;
+    }
+
+    const motor_ramp_step_t * first_step = &motor_config->ramp_steps[first_step_idx];
+    motor_config->step_direction = first_step->step_direction;
+    gpio_put(motor_config->dir_pin, motor_config->step_direction);
+
+    pio_sm_set_enabled(pio, sm, false);
+    stepper_count_program_init(pio, sm, motor_config->stepper_count_program_offset, motor_config->step_pin);
+    pio_interrupt_clear(pio, sm);
+    pio_sm_put(pio, sm, step_cnt);
+    pio_sm_put(pio, sm, first_step->period);
+    pio_sm_set_enabled(pio, sm, true);
+
+    motor_config->counted_move_active = true;
+    motor_config->current_velocity_mrps = first_step->velocity_mrps;
+
+    // The rest of the ramp replaces the period of the running program
+    start_ramp_timer(motor_config, first_step_idx + 1, ramp_time_us);
 }
 
 
-void stepper_speed_control_task(void * p) {    
-    // Currently doing speed control
+/*
+    Start a ramp from the current velocity to the new velocity, following the ramp profile of the motor.
+    The periods are calculated upfront and fed to the PIO by a repeating timer, so the call returns immediately and a 
+    ramp in progress is replaced from the velocity it has reached. A ramp through zero changes the 
+    direction on the way.
+*/
+void speed_ramp(motor_config_t * motor_config, float new_velocity, uint32_t pio_speed) {
+    // Stop the ramp in progress, current_velocity_mrps is no longer updated after this point
+    cancel_repeating_timer(&motor_config->ramp_timer);
+
+    // A counted move is replaced from standstill
+    end_counted_move(motor_config);
+
+    update_period_scale(motor_config, pio_speed);
+
+    uint32_t ramp_time_us = build_ramp(motor_config, motor_config->current_velocity_mrps, (int32_t) lroundf(new_velocity * 1000));
+
+    // Output the first step now, the rest follows at the evenly spaced interval
+    apply_ramp_step(motor_config, &motor_config->ramp_steps[0]);
+    start_ramp_timer(motor_config, 1, ramp_time_us);
+}
+
+
+void stepper_speed_control_task(void * p) {
+    motor_config_t * motor_config = (motor_config_t *) p;
+
     while (true) {
-        // Wait for new speed
-        float new_velocity;
-        xQueueReceive(((motor_config_t *) p)->stepper_speed_control_queue, &new_velocity, portMAX_DELAY);
+        // Wait for new speed, only the latest request is kept in the mailbox
+        stepper_speed_control_t request;
+        xQueueReceive(motor_config->stepper_speed_control_queue, &request, portMAX_DELAY);
 
-        // Calculate the speed of the motor
-        new_velocity /= ((motor_config_t *) p)->persistent_config.gear_ratio;
+        // Calculate the speed and the revolutions of the motor
+        float new_velocity = request.velocity / motor_config->persistent_config.gear_ratio;
+        float revolutions = request.revolutions / motor_config->persistent_config.gear_ratio;
 
         // Get latest PIO speed, in case of the change of system clock
         uint32_t pio_speed = clock_get_hz(clk_sys);
 
-        // Determine if both have same direction (no need to change DIR pin state)
-        if ((new_velocity >= 0) == (((motor_config_t *) p)->prev_velocity >= 0)) {
-            // Same direction means only speed change
-            speed_ramp(((motor_config_t *) p), 
-                       fabs(((motor_config_t *) p)->prev_velocity), 
-                       fabs(new_velocity), 
-                       pio_speed);
+        // Both the ramp and the counted move run in the background, the next request can be taken immediately
+        if (revolutions > 0) {
+            counted_move(motor_config, new_velocity, revolutions, pio_speed);
         }
         else {
-            // Different direction, then ramp down to 0, change direction then ramp up
-            speed_ramp(((motor_config_t *) p), 
-                       fabs(((motor_config_t *) p)->prev_velocity),
-                       0.0f,
-                       pio_speed);
-            ((motor_config_t *) p)->step_direction = !((motor_config_t *) p)->step_direction;
-
-            // Toggle the direction
-            gpio_put(((motor_config_t *) p)->dir_pin, ((motor_config_t *) p)->step_direction);
-
-            // Ramp to the new speed
-            speed_ramp(((motor_config_t *) p), 
-                       0.0f,
-                       fabs(new_velocity),
-                       pio_speed);
+            speed_ramp(motor_config, new_velocity, pio_speed);
         }
 
-        // Update speed
-        ((motor_config_t *) p)->prev_velocity = new_velocity;
+        // The counted moves up to this request are started or replaced, a newer one may be waiting in the mailbox
+        motor_config->counted_move_taken_seq = request.counted_move_seq;
     }
 }   
 
 
+/*
+    Request a new velocity without blocking. The speed control queue holds one item and a newer
+    request overwrites the one not yet taken, so the caller never waits for a ramp to finish and
+    stale set points are not replayed.
+*/
 void motor_set_speed(motor_select_t selected_motor, float new_velocity) {
+    stepper_speed_control_t request = {
+        .velocity = new_velocity,
+        .revolutions = 0,
+    };
+
     if (selected_motor == SELECT_COARSE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
         if (coarse_trickler_motor_config.stepper_speed_control_queue) {
-            xQueueSend(coarse_trickler_motor_config.stepper_speed_control_queue, &new_velocity, portMAX_DELAY);
+            // Replaces any counted move requested so far
+            request.counted_move_seq = coarse_trickler_motor_config.counted_move_request_seq;
+            xQueueOverwrite(coarse_trickler_motor_config.stepper_speed_control_queue, &request);
         }
     }
 
     if (selected_motor == SELECT_FINE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
         if (fine_trickler_motor_config.stepper_speed_control_queue) {
-            xQueueSend(fine_trickler_motor_config.stepper_speed_control_queue, &new_velocity, portMAX_DELAY);
+            request.counted_move_seq = fine_trickler_motor_config.counted_move_request_seq;
+            xQueueOverwrite(fine_trickler_motor_config.stepper_speed_control_queue, &request);
         }
     }
 }
 
 
+static motor_config_t * get_motor_config(motor_select_t selected_motor) {
+    switch (selected_motor) {
+        case SELECT_COARSE_TRICKLER_MOTOR:
+            return &coarse_trickler_motor_config;
+        case SELECT_FINE_TRICKLER_MOTOR:
+            return &fine_trickler_motor_config;
+        default:
+            return NULL;
+    }
+}
+
+
+/*
+    Make the given revolutions of the trickler at the speed (rev/s, negative to reverse) then stop, without
+    blocking. The steps are counted by the PIO so the weight thrown follows the revolutions closely. The move
+    accelerates to the speed at the acceleration of the motor, the ramp steps are counted too, and stops without
+    a ramp. A later motor_set_speed() or motor_move_revolutions() replaces it.
+*/
+bool motor_move_revolutions(motor_select_t selected_motor, float revolutions, float speed) {
+    motor_config_t * motor_config = get_motor_config(selected_motor);
+    if (!motor_config || !motor_config->stepper_speed_control_queue || revolutions <= 0) {
+        return false;
+    }
+
+    // The move is pending until the motor task takes this request or a later one
+    motor_config->counted_move_request_seq += 1;
+
+    stepper_speed_control_t request = {
+        .velocity = speed,
+        .revolutions = revolutions,
+        .counted_move_seq = motor_config->counted_move_request_seq,
+    };
+
+    xQueueOverwrite(motor_config->stepper_speed_control_queue, &request);
+
+    return true;
+}
+
+
+/*
+    Returns true while a counted move is requested or in progress.
+*/
+bool motor_is_moving_revolutions(motor_select_t selected_motor) {
+    motor_config_t * motor_config = get_motor_config(selected_motor);
+    if (!motor_config) {
+        return false;
+    }
+
+    // Requested, not taken by the motor task yet
+    if (motor_config->counted_move_request_seq != motor_config->counted_move_taken_seq) {
+        return true;
+    }
+
+    return motor_config->counted_move_active && 
+           !pio_interrupt_get(motor_config->pio_config.pio, motor_config->pio_config.sm);
+}
+
+
 void motor_enable(motor_select_t selected_motor, bool enable) {
     if (selected_motor == SELECT_COARSE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
         bool en_signal = coarse_trickler_motor_config.persistent_config.inverted_enable ? enable : !enable;
@@ -619,9 +959,9 @@ motor_init_err_t motors_init(void) {
         return MOTOR_INIT_FINE_DRV_ERR;
     }
 
-    // Initialize motor related RTOS control
-    coarse_trickler_motor_config.stepper_speed_control_queue = xQueueCreate(2, sizeof(stepper_speed_control_t));
-    fine_trickler_motor_config.stepper_speed_control_queue = xQueueCreate(2, sizeof(stepper_speed_control_t));
+    // Initialize motor related RTOS control, one slot mailbox holding the latest request
+    coarse_trickler_motor_config.stepper_speed_control_queue = xQueueCreate(1, sizeof(stepper_speed_control_t));
+    fine_trickler_motor_config.stepper_speed_control_queue = xQueueCreate(1, sizeof(stepper_speed_control_t));
 
     // Create one task for each stepper controller
     xTaskCreate(stepper_speed_control_task, 
@@ -638,6 +978,13 @@ motor_init_err_t motors_init(void) {
                 8, 
                 &fine_trickler_motor_config.stepper_speed_control_task_handler);
 
+    // The ramp timer callback runs in the alarm interrupt of the default alarm pool. On the same core the task
+    // and the callback cannot interleave, cancel_repeating_timer() does not wait for a callback running on the
+    // other core, which could then apply a stale ramp step after speed_ramp() or counted_move().
+    UBaseType_t ramp_timer_core_mask = 1 << alarm_pool_core_num(alarm_pool_get_default());
+    vTaskCoreAffinitySet(coarse_trickler_motor_config.stepper_speed_control_task_handler, ramp_timer_core_mask);
+    vTaskCoreAffinitySet(fine_trickler_motor_config.stepper_speed_control_task_handler, ramp_timer_core_mask);
+
     return MOTOR_INIT_OK;
 }
 
@@ -734,13 +1081,15 @@ void populate_rest_motor_config(motor_config_t * motor_config, char * buf, size_
     // m7 (float): gear_ratio
     // m8 (bool): inverted_enable
     // m9 (bool): inverted_direction
+    // m10 (int): ramp_profile
+    // m11 (float): angular_jerk
     // ee (bool): save to eeprom
 
     // Build response
     snprintf(buf, 
              max_len,
              "%s"
-             "{\"m0\":%0.3f,\"m1\":%ld,\"m2\":%d,\"m3\":%d,\"m4\":%d,\"m5\":%d,\"m6\":%0.3f,\"m7\":%0.7f,\"m8\":%s,\"m9\":%s}",
+             "{\"m0\":%0.3f,\"m1\":%ld,\"m2\":%d,\"m3\":%d,\"m4\":%d,\"m5\":%d,\"m6\":%0.3f,\"m7\":%0.7f,\"m8\":%s,\"m9\":%s,\"m10\":%d,\"m11\":%0.3f}",
              http_json_header,
              motor_config->persistent_config.angular_acceleration, 
              motor_config->persistent_config.full_steps_per_rotation,
@@ -751,7 +1100,9 @@ void populate_rest_motor_config(motor_config_t * motor_config, char * buf, size_
              motor_config->persistent_config.min_speed_rps,
              motor_config->persistent_config.gear_ratio,
              boolean_to_string(motor_config->persistent_config.inverted_enable),
-             boolean_to_string(motor_config->persistent_config.inverted_direction));
+             boolean_to_string(motor_config->persistent_config.inverted_direction),
+             motor_config->persistent_config.ramp_profile,
+             motor_config->persistent_config.angular_jerk);
 }
 
 void apply_rest_motor_config(motor_config_t * motor_config, int num_params, char *params[], char *values[]) {
@@ -798,6 +1149,14 @@ void apply_rest_motor_config(motor_config_t * motor_config, int num_params, char
             bool inverted_direction = string_to_boolean(values[idx]);
             motor_config->persistent_config.inverted_direction = inverted_direction;
         }
+        else if (strcmp(params[idx], "m10") == 0) {
+            motor_ramp_profile_t ramp_profile = (motor_ramp_profile_t) atoi(values[idx]);
+            motor_config->persistent_config.ramp_profile = ramp_profile;
+        }
+        else if (strcmp(params[idx], "m11") == 0) {
+            float angular_jerk = strtof(values[idx], NULL);
+            motor_config->persistent_config.angular_jerk = angular_jerk;
+        }
         else if (strcmp(params[idx], "ee") == 0) {
             save_to_eeprom = string_to_boolean(values[idx]);
         }
@@ -4,12 +4,21 @@
 #include <stdint.h>
 #include <FreeRTOS.h>
 #include <queue.h>
+#include "pico/time.h"
 
 #include "common.h"
+#include "motor_period.h"
 #include "http_rest.h"
 
 #define EEPROM_MOTOR_DATA_REV                     5              // 16 byte 
 
+// Revision of the motor_persistent_config_t layout, a configuration saved in a previous layout is migrated
+// by motor_config_init(). 1: released layout, 2: acceleration ramp profile added
+#define EEPROM_MOTOR_DATA_LAYOUT_REV              2
+
+// Maximum number of speed steps of one acceleration ramp
+#define MOTOR_RAMP_TABLE_LEN                      32
+
 
 // Terms
 // Velocity: speed with direction (clockwise or counter-clockwise)
@@ -31,6 +40,12 @@ typedef enum {
 } motor_init_err_t;
 
 
+typedef enum {
+    MOTOR_RAMP_LINEAR = 0,          // Constant acceleration
+    MOTOR_RAMP_S_CURVE = 1,         // Acceleration changes at the jerk limit
+} motor_ramp_profile_t;
+
+
 typedef struct {
     uint32_t full_steps_per_rotation;
     uint16_t current_ma;
@@ -42,11 +57,22 @@ typedef struct {
     float min_speed_rps;
     float gear_ratio;
 
+    motor_ramp_profile_t ramp_profile;
+    float angular_jerk;          // In rev/s^3, used by the S-curve profile
+
     bool inverted_direction;
     bool inverted_enable;
 } motor_persistent_config_t;
 
 
+// One speed step of the acceleration ramp, fed to the stepper PIO by the ramp timer
+typedef struct {
+    int32_t velocity_mrps;              // Velocity in milli-rev/s
+    uint32_t period;
+    bool step_direction;
+} motor_ramp_step_t;
+
+
 typedef struct {
     uint32_t motor_data_rev;
     motor_persistent_config_t motor_data[2];
@@ -68,9 +94,27 @@ typedef struct {
     pio_config_t pio_config;
 
     // Used to store some live data
-    float prev_velocity;
+    int32_t current_velocity_mrps;      // Velocity of the period the PIO is currently running, in milli-rev/s
     bool step_direction;
 
+    // Integer step period conversion, follows the steps per rotation and the system clock
+    motor_period_scale_t period_scale;
+
+    // Acceleration ramp in progress
+    repeating_timer_t ramp_timer;
+    motor_ramp_step_t ramp_steps[MOTOR_RAMP_TABLE_LEN];
+    uint8_t ramp_step_cnt;
+    volatile uint8_t ramp_step_idx;
+
+    // PIO programs, the step counting program replaces the stepper program during a counted move
+    uint stepper_program_offset;
+    uint stepper_count_program_offset;
+    // A counted move is pending while the motor task has not taken the latest requested sequence. A flag
+    // cleared by the task would also be cleared by an older request taken on the other core.
+    volatile uint32_t counted_move_request_seq;
+    volatile uint32_t counted_move_taken_seq;
+    bool counted_move_active;
+
     // RTOS control
     TaskHandle_t stepper_speed_control_task_handler;
     QueueHandle_t stepper_speed_control_queue;
@@ -88,6 +132,8 @@ bool motor_config_init(void);
 bool motor_config_save(void);
 void motor_task(void *p);
 void motor_set_speed(motor_select_t selected_motor, float new_velocity);
+bool motor_move_revolutions(motor_select_t selected_motor, float revolutions, float speed);
+bool motor_is_moving_revolutions(motor_select_t selected_motor);
 uint16_t get_motor_max_speed(motor_select_t selected_motor);
 float get_motor_min_speed(motor_select_t selected_motor);
 void motor_enable(motor_select_t selected_motor, bool enable);
@@ -14,6 +14,7 @@
 #include "common.h"
 #include "profile.h"
 #include "servo_gate.h"
+#include "charge_batch.h"
 
 
 // External modules/varaibles
@@ -23,6 +24,7 @@ extern charge_mode_config_t charge_mode_config;
 extern servo_gate_t servo_gate;
 extern scale_config_t scale_config;
 extern eeprom_profile_data_t profile_data;
+extern charge_batch_config_t charge_batch_config;
 
 
 const char * get_selected_profile_name(void * data, uint16_t idx) {
@@ -165,6 +167,79 @@ uint8_t render_charge_mode_next_button(mui_t * ui, uint8_t msg) {
 }
 
 
+uint8_t render_charge_batch_queue_button(mui_t * ui, uint8_t msg) {
+    switch (msg) {
+        case MUIF_MSG_CURSOR_SELECT:
+        case MUIF_MSG_VALUE_INCREMENT:
+        case MUIF_MSG_VALUE_DECREMENT:
+            // Queue the selected weight and profile, queue again to add more charges
+            charge_batch_add(charge_mode_get_digits_weight(), profile_get_selected_idx(), 1);
+            return mui_GotoFormAutoCursorPosition(ui, 22);
+        default:
+            mui_u8g2_btn_goto_wm_fi(ui, msg);
+            break;
+    }
+
+    return 0;
+}
+
+
+uint8_t render_charge_batch_clear_button(mui_t * ui, uint8_t msg) {
+    switch (msg) {
+        case MUIF_MSG_CURSOR_SELECT:
+        case MUIF_MSG_VALUE_INCREMENT:
+        case MUIF_MSG_VALUE_DECREMENT:
+            charge_batch_clear();
+            return mui_GotoFormAutoCursorPosition(ui, 22);
+        default:
+            mui_u8g2_btn_goto_wm_fi(ui, msg);
+            break;
+    }
+
+    return 0;
+}
+
+
+uint8_t render_charge_batch_summary(mui_t *ui, uint8_t msg) {
+    switch(msg)
+    {
+        case MUIF_MSG_DRAW:
+        {
+            char buf[30];
+            u8g2_t *u8g2 = mui_get_U8g2(ui);
+
+            charge_batch_acquire();
+
+            uint16_t charge_cnt = 0;
+            for (int idx = 0; idx < charge_batch_config.entry_cnt; idx += 1) {
+                charge_cnt += charge_batch_config.entries[idx].charge_cnt;
+            }
+
+            u8g2_SetFont(u8g2, u8g2_font_profont11_tf);
+            snprintf(buf, sizeof(buf), "Entries:%u Charges:%u", charge_batch_config.entry_cnt, charge_cnt);
+            u8g2_DrawStr(u8g2, 5, 25, buf);
+
+            // Position of the next charge
+            if (charge_batch_config.entry_idx < charge_batch_config.entry_cnt) {
+                const charge_batch_entry_t * entry = &charge_batch_config.entries[charge_batch_config.entry_idx];
+
+                snprintf(buf, sizeof(buf), "Next:%0.3f %u/%u",
+                         entry->target_charge_weight, charge_batch_config.charge_idx + 1, entry->charge_cnt);
+                u8g2_DrawStr(u8g2, 5, 35, buf);
+                u8g2_DrawStr(u8g2, 5, 45, profile_data.profiles[entry->profile_idx].name);
+            }
+            else if (charge_batch_config.entry_cnt > 0) {
+                u8g2_DrawStr(u8g2, 5, 35, "Complete");
+            }
+
+            charge_batch_release();
+            break;
+        }
+    }
+    return 0;
+}
+
+
 uint8_t render_profile_misc_details(mui_t *ui, uint8_t msg) {
     switch(msg)
     {
@@ -254,6 +329,11 @@ muif_t muif_list[] = {
 
         MUIF_BUTTON("B1", render_charge_mode_next_button),
 
+        // Batch
+        MUIF_BUTTON("BQ", render_charge_batch_queue_button),
+        MUIF_BUTTON("BC", render_charge_batch_clear_button),
+        MUIF_RO("BS", render_charge_batch_summary),
+
         // Leave
         MUIF_VARIABLE("LV", &exit_state, mui_u8g2_btn_exit_wm_fi),
 
@@ -298,6 +378,8 @@ fds_t fds_data[] = {
     MUI_DATA("MU", 
         MUI_10 "Start|"
         MUI_20 "Cleanup|"
+        MUI_21 "Autotune|"
+        MUI_22 "Batch|"
         MUI_40 "Wireless|"
         MUI_30 "Settings"
         )
@@ -375,6 +457,7 @@ fds_t fds_data[] = {
 
     MUI_STYLE(0)
     MUI_XYAT("BN",14, 59, 10, "Back")
+    MUI_XYT("BQ",64, 59, "Queue")  // Add to the batch, jump to form 22
     MUI_XYAT("LV", 115, 59, 1, "Next")  // APP_STATE_ENTER_CHARGE_MODE
 
     // Menu 20: Cleanup
@@ -388,6 +471,31 @@ fds_t fds_data[] = {
     MUI_XYAT("BN",14, 59, 1, "Back")
     MUI_XYAT("LV", 115, 59, 5, "Next")  // APP_STATE_ENTER_CLEANUP_MODE
 
+    // Menu 21: Autotune
+    MUI_FORM(21)
+    MUI_STYLE(1)
+    MUI_LABEL(5,10, "Warning")
+    MUI_XY("HL", 0,13)
+    MUI_STYLE(0)
+    MUI_LABEL(5, 25, "Put pan on the scale and")
+    MUI_LABEL(5, 37, "press Next to autotune")
+    MUI_XYAT("BN",14, 59, 1, "Back")
+    MUI_XYAT("LV", 115, 59, 11, "Next")  // APP_STATE_ENTER_AUTOTUNE_MODE
+
+    // Menu 22: Batch, entries are queued from the charge weight page or the REST interface
+    MUI_FORM(22)
+    MUI_STYLE(1)
+    MUI_LABEL(5,10, "Batch")
+    MUI_XY("HL", 0,13)
+
+    // Draw summary
+    MUI_AUX("BS")
+
+    MUI_STYLE(0)
+    MUI_XYAT("BN",14, 59, 1, "Back")
+    MUI_XYT("BC",64, 59, "Clear")
+    MUI_XYAT("LV", 115, 59, 12, "Start")  // APP_STATE_ENTER_BATCH_MODE
+
     // Menu 30: Configurations
     MUI_FORM(30)
     MUI_STYLE(1)
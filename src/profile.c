@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdarg.h>
 
 #include "profile.h"
 #include "eeprom.h"
@@ -6,6 +7,7 @@
 
 
 eeprom_profile_data_t profile_data;
+eeprom_profile_model_data_t profile_model_data;
 
 extern void swuart_calcCRC(uint8_t* datagram, uint8_t datagramLength);
 
@@ -94,6 +96,32 @@ const eeprom_profile_data_t default_profile_data = {
 };
 
 
+#define DEFAULT_PROFILE_MODEL {     \
+    .fine_stop_delay_s = 0.0f,      \
+    .learned_charge_cnt = 0,        \
+    .coarse_stop_threshold = 0.0f,  \
+    .coarse_weight_per_rev = 0.0f,  \
+}
+
+const profile_model_t default_profile_model = DEFAULT_PROFILE_MODEL;
+
+const eeprom_profile_model_data_t default_profile_model_data = {
+    .profile_model_data_rev = 0,
+    .predictive_stop_enable = true,
+
+    .adaptive_coarse_stop_enable = true,
+    .fine_trickle_target_weight = 1.0f,
+    .coarse_stop_threshold_max = 10.0f,
+
+    .bulk_charge_enable = false,
+    .bulk_charge_ratio = 0.8f,
+    .bulk_charge_learn_rev = 1.0f,
+    .models = {
+        [0 ... MAX_PROFILE_CNT - 1] = DEFAULT_PROFILE_MODEL,
+    },
+};
+
+
 bool profile_data_save() {
     bool is_ok = save_config(EEPROM_PROFILE_DATA_BASE_ADDR, &profile_data, sizeof(profile_data));
     return is_ok;
@@ -112,8 +140,17 @@ bool profile_data_init() {
         return false;
     }
 
+    // Read learned models
+    is_ok = load_config(EEPROM_PROFILE_MODEL_BASE_ADDR, &profile_model_data, &default_profile_model_data, sizeof(profile_model_data), EEPROM_PROFILE_MODEL_DATA_REV);
+
+    if (!is_ok) {
+        printf("Unable to read profile model data\n");
+        return false;
+    }
+
     // Register to eeprom save all
     eeprom_register_handler(profile_data_save);
+    eeprom_register_handler(profile_model_save);
 
     return true;
 }
@@ -136,6 +173,32 @@ profile_t * profile_select(uint8_t idx) {
 }
 
 
+bool profile_model_save() {
+    bool is_ok = save_config(EEPROM_PROFILE_MODEL_BASE_ADDR, &profile_model_data, sizeof(profile_model_data));
+    return is_ok;
+}
+
+
+profile_model_t * profile_get_selected_model() {
+    return &profile_model_data.models[profile_get_selected_idx()];
+}
+
+
+void profile_model_reset(uint8_t idx) {
+    if (idx < MAX_PROFILE_CNT) {
+        profile_model_t * model = &profile_model_data.models[idx];
+
+        // The feed-forward time budgets are settings of the profile, not learned
+        float coarse_feed_forward_time_s = model->coarse_feed_forward_time_s;
+        float fine_feed_forward_time_s = model->fine_feed_forward_time_s;
+
+        *model = default_profile_model;
+        model->coarse_feed_forward_time_s = coarse_feed_forward_time_s;
+        model->fine_feed_forward_time_s = fine_feed_forward_time_s;
+    }
+}
+
+
 void profile_update_checksum() {
     swuart_calcCRC((uint8_t *) profile_get_selected(), sizeof(profile_t));
 }
@@ -156,8 +219,11 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
     // p10 (float): fine_kd
     // p11 (float): fine_min_flow_speed_rps
     // p12 (float): fine_max_flow_speed_rps
+    // p13 (float): coarse_feed_forward_time_s, 0 to disable
+    // p14 (float): fine_feed_forward_time_s, 0 to disable
+    // (p13 and p14 are kept in the profile model block, so the profile layout is unchanged)
     // ee (bool): save to eeprom
-    static char buf[256];
+    static char buf[384];
 
     // Read the current loaded profile index
     uint8_t profile_idx = profile_get_selected_idx();
@@ -175,6 +241,7 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
 
     else {
         profile_t * current_profile = profile_select(profile_idx);
+        profile_model_t * current_model = &profile_model_data.models[profile_idx];
         bool save_to_eeprom = false;
 
         // Control
@@ -218,6 +285,12 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
             else if (strcmp(params[idx], "p12") == 0) {
                 current_profile->fine_max_flow_speed_rps = strtof(values[idx], NULL);
             }
+            else if (strcmp(params[idx], "p13") == 0) {
+                current_model->coarse_feed_forward_time_s = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p14") == 0) {
+                current_model->fine_feed_forward_time_s = strtof(values[idx], NULL);
+            }
             else if (strcmp(params[idx], "ee") == 0) {
                 save_to_eeprom = string_to_boolean(values[idx]);
             }
@@ -226,12 +299,13 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
         // Perform action
         if (save_to_eeprom) {
             profile_data_save();
+            profile_model_save();
         }
 
         // Response
         snprintf(buf, sizeof(buf), 
                  "%s"
-                 "{\"pf\":%d,\"p0\":%ld,\"p1\":%ld,\"p2\":\"%s\",\"p3\":%0.3f,\"p4\":%0.3f,\"p5\":%0.3f,\"p6\":%0.3f,\"p7\":%0.3f,\"p8\":%0.3f,\"p9\":%0.3f,\"p10\":%0.3f,\"p11\":%0.3f,\"p12\":%0.3f}",
+                 "{\"pf\":%d,\"p0\":%ld,\"p1\":%ld,\"p2\":\"%s\",\"p3\":%0.3f,\"p4\":%0.3f,\"p5\":%0.3f,\"p6\":%0.3f,\"p7\":%0.3f,\"p8\":%0.3f,\"p9\":%0.3f,\"p10\":%0.3f,\"p11\":%0.3f,\"p12\":%0.3f,\"p13\":%0.3f,\"p14\":%0.3f}",
                  http_json_header,
                  profile_idx, 
                  current_profile->rev,
@@ -246,7 +320,9 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
                  current_profile->fine_ki,
                  current_profile->fine_kd,
                  current_profile->fine_min_flow_speed_rps,
-                 current_profile->fine_max_flow_speed_rps);
+                 current_profile->fine_max_flow_speed_rps,
+                 current_model->coarse_feed_forward_time_s,
+                 current_model->fine_feed_forward_time_s);
     }
 
     size_t response_len = strlen(buf);
@@ -301,4 +377,217 @@ bool http_rest_profile_summary(struct fs_file *file, int num_params, char *param
     file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
 
     return true;
-}
\ No newline at end of file
+}
+
+
+bool http_rest_profile_model(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings:
+    // pf (int): profile index, default to the current loaded profile
+    // m0 (bool): predictive_stop_enable (all profiles)
+    // m1 (float): fine_stop_delay_s
+    // m2 (int): learned_charge_cnt (read only)
+    // m3 (bool): adaptive_coarse_stop_enable (all profiles)
+    // m4 (float): fine_trickle_target_weight (all profiles)
+    // m5 (float): coarse_stop_threshold_max (all profiles)
+    // m6 (float): coarse_stop_threshold, 0 to start from the charge mode setting
+    // m7 (bool): bulk_charge_enable (all profiles)
+    // m8 (float): bulk_charge_learn_rev (all profiles)
+    // m9 (float): coarse_weight_per_rev, 0 to learn again
+    // m10 (float): bulk_charge_ratio (all profiles)
+    // rs (bool): reset the learned model of the profile
+    // ee (bool): save to eeprom
+    static char buf[256];
+
+    uint8_t profile_idx = profile_get_selected_idx();
+
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "pf") == 0) {
+            profile_idx = (uint8_t) atoi(values[idx]);
+        }
+    }
+
+    if (profile_idx >= MAX_PROFILE_CNT) {
+        snprintf(buf, sizeof(buf), "%s{\"error\":\"InvalidProfileIndex\"}", http_json_header);
+    }
+    else {
+        profile_model_t * model = &profile_model_data.models[profile_idx];
+        bool save_to_eeprom = false;
+
+        // Control
+        for (int idx = 0; idx < num_params; idx += 1) {
+            if (strcmp(params[idx], "rs") == 0 && string_to_boolean(values[idx])) {
+                profile_model_reset(profile_idx);
+            }
+        }
+        for (int idx = 0; idx < num_params; idx += 1) {
+            if (strcmp(params[idx], "m0") == 0) {
+                profile_model_data.predictive_stop_enable = string_to_boolean(values[idx]);
+            }
+            else if (strcmp(params[idx], "m1") == 0) {
+                model->fine_stop_delay_s = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "m3") == 0) {
+                profile_model_data.adaptive_coarse_stop_enable = string_to_boolean(values[idx]);
+            }
+            else if (strcmp(params[idx], "m4") == 0) {
+                profile_model_data.fine_trickle_target_weight = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "m5") == 0) {
+                profile_model_data.coarse_stop_threshold_max = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "m6") == 0) {
+                model->coarse_stop_threshold = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "m7") == 0) {
+                profile_model_data.bulk_charge_enable = string_to_boolean(values[idx]);
+            }
+            else if (strcmp(params[idx], "m8") == 0) {
+                profile_model_data.bulk_charge_learn_rev = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "m9") == 0) {
+                model->coarse_weight_per_rev = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "m10") == 0) {
+                profile_model_data.bulk_charge_ratio = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "ee") == 0) {
+                save_to_eeprom = string_to_boolean(values[idx]);
+            }
+        }
+
+        // Perform action
+        if (save_to_eeprom) {
+            profile_model_save();
+        }
+
+        // Response
+        snprintf(buf, sizeof(buf), 
+                 "%s"
+                 "{\"pf\":%d,\"m0\":%s,\"m1\":%0.3f,\"m2\":%lu,\"m3\":%s,\"m4\":%0.3f,\"m5\":%0.3f,\"m6\":%0.3f,\"m7\":%s,\"m8\":%0.3f,\"m9\":%0.4f,\"m10\":%0.3f}",
+                 http_json_header,
+                 profile_idx, 
+                 boolean_to_string(profile_model_data.predictive_stop_enable),
+                 model->fine_stop_delay_s,
+                 model->learned_charge_cnt,
+                 boolean_to_string(profile_model_data.adaptive_coarse_stop_enable),
+                 profile_model_data.fine_trickle_target_weight,
+                 profile_model_data.coarse_stop_threshold_max,
+                 model->coarse_stop_threshold,
+                 boolean_to_string(profile_model_data.bulk_charge_enable),
+                 profile_model_data.bulk_charge_learn_rev,
+                 model->coarse_weight_per_rev,
+                 profile_model_data.bulk_charge_ratio);
+    }
+
+    size_t response_len = strlen(buf);
+    file->data = buf;
+    file->len = response_len;
+    file->index = response_len;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
+
+
+/*
+    Append the formatted text at len and return the new length. The text is truncated at the end of the
+    buffer and the length never goes past it, so the appends can be chained.
+*/
+static int append_json(char * buf, size_t max_len, int len, const char * format, ...) {
+    if (len >= (int) max_len - 1) {
+        return len;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int appended_len = vsnprintf(buf + len, max_len - len, format, args);
+    va_end(args);
+
+    if (appended_len < 0) {
+        return len;
+    }
+    if (len + appended_len >= (int) max_len) {
+        return (int) max_len - 1;
+    }
+
+    return len + appended_len;
+}
+
+
+static int populate_flow_model(char * buf, size_t max_len, int len, const flow_model_t * model) {
+    len = append_json(buf, max_len, len, "[");
+
+    for (int bin = 0; bin < FLOW_MODEL_SPEED_BIN_CNT; bin += 1) {
+        len = append_json(buf, max_len, len,
+                          "%s[%0.4f,%u]",
+                          bin ? "," : "",
+                          model->weight_per_rev[bin],
+                          model->sample_cnt[bin]);
+    }
+
+    return append_json(buf, max_len, len, "]");
+}
+
+
+bool http_rest_profile_flow_model(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings:
+    // pf (int): profile index, default to the current loaded profile
+    // e (read only): upper speed edge of each bin in rev/s, the last bin has no upper limit
+    // c (read only): [weight_per_rev, sample_cnt] of the coarse trickler in each speed bin
+    // f (read only): [weight_per_rev, sample_cnt] of the fine trickler in each speed bin
+    // rs (bool): reset the flow model of the profile
+    // ee (bool): save to eeprom
+    static char buf[512];
+
+    uint8_t profile_idx = profile_get_selected_idx();
+    bool save_to_eeprom = false;
+    bool reset = false;
+
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "pf") == 0) {
+            profile_idx = (uint8_t) atoi(values[idx]);
+        }
+        else if (strcmp(params[idx], "rs") == 0) {
+            reset = string_to_boolean(values[idx]);
+        }
+        else if (strcmp(params[idx], "ee") == 0) {
+            save_to_eeprom = string_to_boolean(values[idx]);
+        }
+    }
+
+    if (profile_idx >= MAX_PROFILE_CNT) {
+        snprintf(buf, sizeof(buf), "%s{\"error\":\"InvalidProfileIndex\"}", http_json_header);
+    }
+    else {
+        profile_model_t * model = &profile_model_data.models[profile_idx];
+
+        if (reset) {
+            flow_model_reset(&model->coarse_flow_model);
+            flow_model_reset(&model->fine_flow_model);
+        }
+
+        if (save_to_eeprom) {
+            profile_model_save();
+        }
+
+        static const float speed_bin_edges[] = FLOW_MODEL_SPEED_BIN_EDGES;
+
+        int len = append_json(buf, sizeof(buf), 0, "%s{\"pf\":%d,\"e\":[", http_json_header, profile_idx);
+        for (size_t bin = 0; bin < sizeof(speed_bin_edges) / sizeof(speed_bin_edges[0]); bin += 1) {
+            len = append_json(buf, sizeof(buf), len, "%s%0.2f", bin ? "," : "", speed_bin_edges[bin]);
+        }
+        len = append_json(buf, sizeof(buf), len, "],\"c\":");
+        len = populate_flow_model(buf, sizeof(buf), len, &model->coarse_flow_model);
+        len = append_json(buf, sizeof(buf), len, ",\"f\":");
+        len = populate_flow_model(buf, sizeof(buf), len, &model->fine_flow_model);
+        append_json(buf, sizeof(buf), len, "}");
+    }
+
+    size_t response_len = strlen(buf);
+    file->data = buf;
+    file->len = response_len;
+    file->index = response_len;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
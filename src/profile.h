@@ -4,12 +4,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "http_rest.h"
+#include "flow_model.h"
 
 
 #define PROFILE_NAME_MAX_LEN    16
 #define MAX_PROFILE_CNT         8
 
 #define EEPROM_PROFILE_DATA_REV             1           // 16 bit
+#define EEPROM_PROFILE_MODEL_DATA_REV       1           // 16 bit
 
 typedef struct
 {  
@@ -42,6 +44,49 @@ typedef struct {
 } eeprom_profile_data_t;
 
 
+// Charge behaviour learned for each profile. Kept in a separate block so the learned values
+// can be reset without touching the profile itself.
+typedef struct {
+    // Delay between the fine trickler stop and the weight settle, used to predict the in-flight powder
+    float fine_stop_delay_s;
+    uint32_t learned_charge_cnt;
+
+    // Coarse trickler stop threshold, 0 to start from the charge mode setting
+    float coarse_stop_threshold;
+
+    // Weight thrown by one revolution of the coarse trickler, 0 if not learned yet
+    float coarse_weight_per_rev;
+
+    // Flow of each trickler against the speed, recorded during the charges
+    flow_model_t coarse_flow_model;
+    flow_model_t fine_flow_model;
+
+    // Feed-forward from the flow model: the speed that delivers the remaining weight within the
+    // time budget is added to the PID output. 0 to disable. Set with the profile, kept on a reset.
+    float coarse_feed_forward_time_s;
+    float fine_feed_forward_time_s;
+} profile_model_t;
+
+
+typedef struct {
+    uint16_t profile_model_data_rev;
+
+    bool predictive_stop_enable;
+
+    // Adaptive coarse stop threshold
+    bool adaptive_coarse_stop_enable;
+    float fine_trickle_target_weight;       // Weight left to the fine trickler after the coarse trickler settles
+    float coarse_stop_threshold_max;
+
+    // Volumetric bulk charge by the coarse trickler, measured by the counted revolutions
+    bool bulk_charge_enable;
+    float bulk_charge_ratio;                // Share of the coarse trickler weight thrown by the bulk charge
+    float bulk_charge_learn_rev;            // Revolutions thrown to learn the weight per revolution
+
+    profile_model_t models[MAX_PROFILE_CNT];
+} eeprom_profile_model_data_t;
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -54,10 +99,18 @@ bool profile_data_save();
 
 profile_t * profile_select(uint8_t idx);
 profile_t * profile_get_selected();
+uint16_t profile_get_selected_idx();
+
+// Learned model
+bool profile_model_save();
+profile_model_t * profile_get_selected_model();
+void profile_model_reset(uint8_t idx);
 
 // REST interface
 bool http_rest_profile_config(struct fs_file *file, int num_params, char *params[], char *values[]);
 bool http_rest_profile_summary(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_profile_model(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_profile_flow_model(struct fs_file *file, int num_params, char *params[], char *values[]);
 
 
 #ifdef __cplusplus
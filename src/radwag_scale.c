@@ -10,111 +10,10 @@
 #include "scale.h"
 #include "app.h"
 
-// Radwag response frame structure for SUI command
-// Format: SUI<stability><mass(12)><unit(3)>CR LF
-// Example: "SUI        1.56 gr \r\n" (stable)
-//          "SUI?       2.18 gr \r\n" (unstable)
-typedef union {
-    struct __attribute__((__packed__)) {
-        char command[3];        // "SUI" - immediate reading in current unit
-        char stability;         // ' ' stable, '?' unstable, '^' overflow+, 'v' overflow-
-        char mass[12];          // 12 chars right-aligned with spaces and dot
-        char unit[3];           // 3 chars (usually "gr " with trailing space)
-        char terminator[2];     // CR LF
-    };
-    char bytes[21];
-} radwag_sui_frame_t;
-
-// Forward declarations
-void _radwag_scale_listener_task(void *p);
-void radwag_scale_press_re_zero_key();
-
-extern scale_config_t scale_config;
-
-// Instance of the scale handle for Radwag PS R2 series
-scale_handle_t radwag_ps_r2_scale_handle = {
-    .read_loop_task = _radwag_scale_listener_task,
-    .force_zero = radwag_scale_press_re_zero_key,
-};
-
-/**
- * @brief Decode mass measurement message from Radwag scale
- * 
- * @param msg Pointer to mass frame structure
- * @return float Decoded weight value, NaN if conversion failed
- */
-static float _decode_measurement_msg(radwag_sui_frame_t *msg) {
-    // Create a temporary buffer for mass conversion
-    // Mass field is 12 characters with spaces padding on the left
-    char mass_str[13];
-    memcpy(mass_str, msg->mass, 12);
-    mass_str[12] = '\0';
-    
-    // Convert mass string to float (strtof handles leading spaces)
-    char *endptr;
-    float weight = strtof(mass_str, &endptr);
-    
-    if (endptr == mass_str) {
-        // Conversion failed
-        return nanf(mass_str);
-    }
-    
-    // Note: The mass field in SUI doesn't have a separate sign character
-    // Negative values would include '-' in the mass field itself
-    
-    return weight;
-}
-
-/**
- * @brief Main listener task for Radwag scale communication
- * Continuously reads data from continuous transmission mode
- * 
- * @param p Task parameter (unused)
- */
-void _radwag_scale_listener_task(void *p) {
-    uint8_t string_buf_idx = 0;
-    radwag_sui_frame_t frame;
-    
-    while (true) {
-        // Read all available data
-        while (uart_is_readable(SCALE_UART)) {
-            char ch = uart_getc(SCALE_UART);
-            frame.bytes[string_buf_idx++] = ch;
-            
-            // Radwag SUI frame is 21 bytes
-            if (string_buf_idx == sizeof(radwag_sui_frame_t)) {
-                // Verify this is a SUI mass frame
-                if (frame.command[0] == 'S' && 
-                    frame.command[1] == 'U' && 
-                    frame.command[2] == 'I') {
-                    
-                    // Optional: Check stability flag
-                    // ' ' = stable, '?' = unstable
-                    // You can decide whether to accept unstable readings
-                    // bool is_stable = (frame.stability == ' ');
-                    
-                    // Data is ready, decode and update
-                    scale_config.current_scale_measurement = _decode_measurement_msg(&frame);
-                    
-                    // Signal that data is ready
-                    if (scale_config.scale_measurement_ready) {
-                        xSemaphoreGive(scale_config.scale_measurement_ready);
-                    }
-                }
-                
-                // Reset buffer
-                string_buf_idx = 0;
-            }
-            
-            // Reset on line terminator to resynchronize if out of sync
-            if (ch == '\n') {
-                string_buf_idx = 0;
-            }
-        }
-        
-        vTaskDelay(pdMS_TO_TICKS(20));
-    }
-}
+/*
+    Radwag PS R2 commands. The SUI frames are decoded by the shared listener, see the protocol table in
+    scale_protocol.c.
+*/
 
 /**
  * @brief Zero the scale (send Z command)
@@ -12,6 +12,8 @@
 #include "neopixel_led.h"
 #include "profile.h"
 #include "cleanup_mode.h"
+#include "autotune_mode.h"
+#include "charge_batch.h"
 #include "servo_gate.h"
 #include "system_control.h"
 
@@ -83,9 +85,13 @@ bool rest_endpoints_init(bool default_wizard) {
     rest_register_handler("/404", http_404_error);
     rest_register_handler("/rest/scale_action", http_rest_scale_action);
     rest_register_handler("/rest/scale_config", http_rest_scale_config);
+    rest_register_handler("/rest/scale_telemetry", http_rest_scale_telemetry);
     rest_register_handler("/rest/charge_mode_config", http_rest_charge_mode_config);
     rest_register_handler("/rest/charge_mode_state", http_rest_charge_mode_state);
+    rest_register_handler("/rest/charge_timing", http_rest_charge_timing);
     rest_register_handler("/rest/cleanup_mode_state", http_rest_cleanup_mode_state);
+    rest_register_handler("/rest/autotune_mode_state", http_rest_autotune_mode_state);
+    rest_register_handler("/rest/charge_batch", http_rest_charge_batch);
     rest_register_handler("/rest/system_control", http_rest_system_control);
     rest_register_handler("/rest/coarse_motor_config", http_rest_coarse_motor_config);
     rest_register_handler("/rest/fine_motor_config", http_rest_fine_motor_config);
@@ -95,6 +101,8 @@ bool rest_endpoints_init(bool default_wizard) {
     rest_register_handler("/rest/neopixel_led_config", http_rest_neopixel_led_config);
     rest_register_handler("/rest/profile_config", http_rest_profile_config);
     rest_register_handler("/rest/profile_summary", http_rest_profile_summary);
+    rest_register_handler("/rest/profile_model", http_rest_profile_model);
+    rest_register_handler("/rest/profile_flow_model", http_rest_profile_flow_model);
     rest_register_handler("/rest/servo_gate_state", http_rest_servo_gate_state);
     rest_register_handler("/rest/servo_gate_config", http_rest_servo_gate_config);
     rest_register_handler("/display_buffer", http_get_display_buffer);
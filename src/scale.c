@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <semphr.h>
 #include <inttypes.h>
+#include <ctype.h>
+#include "hardware/irq.h"
 
 #include "configuration.h"
 #include "scale.h"
@@ -11,18 +13,25 @@
 #include "app.h"
 #include "scale.h"
 #include "common.h"
+#include "scale_protocol.h"
 
-extern scale_handle_t generic_scale_drv_handle;
-extern scale_handle_t and_fxi_scale_handle;
-extern scale_handle_t steinberg_scale_handle;
-extern scale_handle_t ussolid_scale_handle;
-extern scale_handle_t gng_scale_handle;
-extern scale_handle_t jm_science_scale_handle;
-extern scale_handle_t creedmoor_scale_handle;
-extern scale_handle_t radwag_ps_r2_scale_handle;
-extern scale_handle_t sartorius_scale_handle;
+
+// Size of the receive ring buffer, must be power of 2
+#define SCALE_RX_BUFFER_SIZE    256
+
+// Number of samples buffered for the REST telemetry between polls
+#define SCALE_TELEMETRY_DEPTH   16
 
 scale_config_t scale_config;
+
+// Receive ring buffer filled by the UART RX interrupt and drained by the listener task
+static volatile char scale_rx_buffer[SCALE_RX_BUFFER_SIZE];
+static volatile uint16_t scale_rx_head = 0;
+static volatile uint16_t scale_rx_tail = 0;
+static volatile uint64_t scale_rx_terminator_time_us = 0;
+
+static QueueHandle_t scale_telemetry_subscriber = NULL;
+
 const eeprom_scale_data_t default_scale_persistent_config = {
     .scale_data_rev = 0,
     .scale_driver = SCALE_DRIVER_AND_FXI,
@@ -31,59 +40,50 @@ const eeprom_scale_data_t default_scale_persistent_config = {
 };
 
 
+static void scale_uart_rx_isr() {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    bool terminator_received = false;
+    uint64_t isr_time_us = time_us_64();
+
+    // Drain the hardware FIFO. The ISR is triggered either by the FIFO level or by
+    // the RX timeout (32 bit periods of idle line), whichever comes first.
+    while (uart_is_readable(SCALE_UART)) {
+        char ch = uart_getc(SCALE_UART);
+        uint16_t next_head = (scale_rx_head + 1) & (SCALE_RX_BUFFER_SIZE - 1);
+
+        // Drop the byte when the listener falls behind, the driver will resync
+        // on the next terminator
+        if (next_head != scale_rx_tail) {
+            scale_rx_buffer[scale_rx_head] = ch;
+            scale_rx_head = next_head;
+        }
+
+        if (ch == '\n' || ch == '\r') {
+            terminator_received = true;
+        }
+    }
+
+    // Wake the listener as soon as a complete line is available
+    if (terminator_received) {
+        scale_rx_terminator_time_us = isr_time_us;
+    }
+    if (terminator_received && scale_config.scale_listener_task_handler) {
+        vTaskNotifyGiveFromISR(scale_config.scale_listener_task_handler, &higher_priority_task_woken);
+    }
+
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+
 void set_scale_driver(scale_driver_t scale_driver) {
     // Update the persistent settings
     scale_config.persistent_config.scale_driver = scale_driver;
-    
-    switch (scale_driver) {
-        case SCALE_DRIVER_AND_FXI:
-        {
-            scale_config.scale_handle = &and_fxi_scale_handle;
-            break;
-        }
-        case SCALE_DRIVER_STEINBERG_SBS:
-        {
-            scale_config.scale_handle = &steinberg_scale_handle;
-            break;
-        }
-        case SCALE_DRIVER_GNG_JJB:
-        {
-            scale_config.scale_handle = &gng_scale_handle;
-            break;
-        }
-        case SCALE_DRIVER_USSOLID_JFDBS:
-        {
-            scale_config.scale_handle = &ussolid_scale_handle;
-            break;
-        }
-        case SCALE_DRIVER_JM_SCIENCE:
-        {
-            scale_config.scale_handle = &jm_science_scale_handle;
-            break;
-        }
-        case SCALE_DRIVER_CREEDMOOR:
-        {
-            scale_config.scale_handle = &creedmoor_scale_handle;
-            break;
-        }
-        case SCALE_DRIVER_RADWAG_PS_R2:
-        {
-            scale_config.scale_handle = &radwag_ps_r2_scale_handle;
-            break;
-        }
-        case SCALE_DRIVER_SARTORIUS:
-        {
-            scale_config.scale_handle = &sartorius_scale_handle;
-            break;
-        }
-        case SCALE_DRIVER_GENERIC_DRV:
-        {
-            scale_config.scale_handle = &generic_scale_drv_handle;
-            break;
-        }
-        default:
-            scale_config.scale_handle = &and_fxi_scale_handle;
-            break;
+
+    scale_config.scale_handle = scale_protocol_select(scale_driver);
+
+    // Wake the listener to pick up the new protocol
+    if (scale_config.scale_listener_task_handler) {
+        xTaskNotifyGive(scale_config.scale_listener_task_handler);
     }
 }
 
@@ -130,41 +130,66 @@ void set_scale_baudrate(scale_baudrate_t baudrate) {
 
 
 const char * get_scale_driver_string() {
-    const char * scale_driver_string = NULL;
+    const scale_protocol_t * protocol = scale_protocol_get(scale_config.persistent_config.scale_driver);
 
-    switch (scale_config.persistent_config.scale_driver) {
-        case SCALE_DRIVER_AND_FXI:
-            scale_driver_string = "AND FX-i Std";
-            break;
-        case SCALE_DRIVER_STEINBERG_SBS:
-            scale_driver_string = "Steinberg SBS";
-            break;
-        case SCALE_DRIVER_USSOLID_JFDBS:
-            scale_driver_string = "US Solid JFDBS";
-            break;
-        case SCALE_DRIVER_GNG_JJB:
-            scale_driver_string = "GNG JJB";
-            break;
-        case SCALE_DRIVER_JM_SCIENCE:
-            scale_driver_string = "JM Science";
-            break;
-        case SCALE_DRIVER_CREEDMOOR:
-            scale_driver_string = "Creedmoor";
-            break;
-        case SCALE_DRIVER_RADWAG_PS_R2:
-            scale_driver_string = "Radwag PS R2";
-            break;
-        case SCALE_DRIVER_SARTORIUS:
-            scale_driver_string = "Sartorius";
-            break;
-        case SCALE_DRIVER_GENERIC_DRV:
-            scale_driver_string = "Generic Driver";
-            break;
-        default:
-            break;
+    return protocol ? protocol->name : NULL;
+}
+
+
+scale_unit_t scale_parse_unit(const char * unit, size_t len) {
+    // Strip the padding and the terminator
+    while (len > 0 && isspace((unsigned char) *unit)) {
+        unit++;
+        len--;
+    }
+    while (len > 0 && (isspace((unsigned char) unit[len - 1]) || unit[len - 1] == '\0')) {
+        len--;
+    }
+
+    char lower_unit[4] = {0};
+    if (len == 0 || len >= sizeof(lower_unit)) {
+        return SCALE_UNIT_UNKNOWN;
+    }
+    for (size_t idx = 0; idx < len; idx++) {
+        lower_unit[idx] = tolower((unsigned char) unit[idx]);
+    }
+
+    // Grain is reported as GN by most scales and as gr by Radwag
+    if (strcmp(lower_unit, "gn") == 0 || strcmp(lower_unit, "gr") == 0) {
+        return SCALE_UNIT_GRAIN;
     }
+    else if (strcmp(lower_unit, "g") == 0) {
+        return SCALE_UNIT_GRAM;
+    }
+    else if (strcmp(lower_unit, "ct") == 0) {
+        return SCALE_UNIT_CARAT;
+    }
+    else if (strcmp(lower_unit, "oz") == 0) {
+        return SCALE_UNIT_OUNCE;
+    }
+    else if (strcmp(lower_unit, "lb") == 0) {
+        return SCALE_UNIT_POUND;
+    }
+
+    return SCALE_UNIT_UNKNOWN;
+}
+
 
-    return scale_driver_string;
+const char * get_scale_unit_string(scale_unit_t unit) {
+    switch (unit) {
+        case SCALE_UNIT_GRAIN:
+            return "gr";
+        case SCALE_UNIT_GRAM:
+            return "g";
+        case SCALE_UNIT_CARAT:
+            return "ct";
+        case SCALE_UNIT_OUNCE:
+            return "oz";
+        case SCALE_UNIT_POUND:
+            return "lb";
+        default:
+            return "";
+    }
 }
 
 
@@ -188,21 +213,37 @@ bool scale_init() {
     gpio_set_function(SCALE_UART_RX, GPIO_FUNC_UART);
 
     // Create control variables
-    // Semaphore to indicate the availability of new measurement. 
-    scale_config.scale_measurement_ready = xSemaphoreCreateBinary();
-
     // Mutex to control the access to the serial port write
     scale_config.scale_serial_write_access_mutex = xSemaphoreCreateMutex();
 
     // Initialize the measurement variable
-    scale_config.current_scale_measurement = NAN;
+    scale_config.current_measurement.weight = NAN;
+    scale_config.current_measurement.timestamp_us = 0;
+    scale_config.current_measurement.seq = 0;
+    scale_config.current_measurement.is_stable = false;
+    scale_config.subscriber_count = 0;
 
     // Initialize the driver handle
     printf("Scale driver: %x\n", scale_config.persistent_config.scale_driver);
     set_scale_driver(scale_config.persistent_config.scale_driver);
 
     // Create the Task for the listener loop
-    xTaskCreate(scale_config.scale_handle->read_loop_task, "Scale Task", configMINIMAL_STACK_SIZE, NULL, 9, NULL);
+    BaseType_t task_created = xTaskCreate(scale_config.scale_handle->read_loop_task, 
+                                          "Scale Task", 
+                                          configMINIMAL_STACK_SIZE, 
+                                          NULL, 
+                                          9, 
+                                          &scale_config.scale_listener_task_handler);
+    if (task_created != pdPASS) {
+        printf("Unable to create scale listener task\n");
+        return false;
+    }
+
+    // Enable the RX interrupt once the listener is ready to be notified
+    int scale_uart_irq = SCALE_UART == uart0 ? UART0_IRQ : UART1_IRQ;
+    irq_set_exclusive_handler(scale_uart_irq, scale_uart_rx_isr);
+    irq_set_enabled(scale_uart_irq, true);
+    uart_set_irq_enables(SCALE_UART, true, false);
 
     // Register to eeprom save all
     eeprom_register_handler(scale_config_save);
@@ -242,17 +283,28 @@ void scale_write(const char * command, size_t len) {
 }
 
 
-float scale_get_current_measurement() {
-    return scale_config.current_scale_measurement;
+/*
+    Read one byte received from the scale. Returns false if the receive buffer is empty.
+*/
+bool scale_read_char(char * ch) {
+    if (scale_rx_tail == scale_rx_head) {
+        return false;
+    }
+
+    *ch = scale_rx_buffer[scale_rx_tail];
+    scale_rx_tail = (scale_rx_tail + 1) & (SCALE_RX_BUFFER_SIZE - 1);
+
+    return true;
 }
 
 
 /*
-    Block wait for the next available measurement.
+    Block wait until the RX interrupt reports a line terminator from the scale. Must be 
+    called from the listener task.
 
     block_time_ms set to 0 to wait indefinitely.
 */
-bool scale_block_wait_for_next_measurement(uint32_t block_time_ms, float * current_measurement) {
+bool scale_wait_for_data(uint32_t block_time_ms) {
     TickType_t delay_ticks;
 
     if (block_time_ms == 0) {
@@ -262,15 +314,137 @@ bool scale_block_wait_for_next_measurement(uint32_t block_time_ms, float * curre
         delay_ticks = pdMS_TO_TICKS(block_time_ms);
     }
 
-    // You can only call this once the scheduler starts
-    if (xSemaphoreTake(scale_config.scale_measurement_ready, delay_ticks) == pdTRUE){
-        *current_measurement = scale_get_current_measurement();
+    if (ulTaskNotifyTake(pdTRUE, delay_ticks) > 0) {
+        return true;
+    }
+
+    // Partial data may still be waiting for its terminator
+    return scale_rx_tail != scale_rx_head;
+}
+
+
+float scale_get_current_measurement() {
+    return scale_config.current_measurement.weight;
+}
+
+
+scale_measurement_t scale_get_latest_sample() {
+    scale_measurement_t sample;
+
+    taskENTER_CRITICAL();
+    sample = scale_config.current_measurement;
+    taskEXIT_CRITICAL();
+
+    return sample;
+}
+
+
+/*
+    Create a subscription to the sample bus. Every subscriber receives every published sample, 
+    a subscriber that falls behind by more than depth samples loses the oldest ones.
+
+    Returns NULL if no more subscriber can be added.
+*/
+QueueHandle_t scale_subscribe(uint8_t depth) {
+    if (scale_config.subscriber_count >= SCALE_MAX_SUBSCRIBERS) {
+        printf("Unable to add more scale subscriber\n");
+        return NULL;
+    }
+
+    QueueHandle_t subscriber = xQueueCreate(depth, sizeof(scale_measurement_t));
+    if (subscriber == NULL) {
+        printf("Unable to create scale subscriber queue\n");
+        return NULL;
+    }
+
+    taskENTER_CRITICAL();
+    scale_config.subscribers[scale_config.subscriber_count] = subscriber;
+    scale_config.subscriber_count += 1;
+    taskEXIT_CRITICAL();
+
+    return subscriber;
+}
+
+
+static inline TickType_t _block_time_to_ticks(uint32_t block_time_ms) {
+    if (block_time_ms == 0) {
+        return portMAX_DELAY;
+    }
+
+    return pdMS_TO_TICKS(block_time_ms);
+}
+
+
+/*
+    Block wait for the next sample on the subscription, in the order of publish.
+
+    block_time_ms set to 0 to wait indefinitely.
+*/
+bool scale_wait_for_next_sample(QueueHandle_t subscriber, uint32_t block_time_ms, scale_measurement_t * sample) {
+    return xQueueReceive(subscriber, sample, _block_time_to_ticks(block_time_ms)) == pdTRUE;
+}
+
+
+/*
+    Discard the queued samples and return the newest one. Block wait for the next sample only 
+    if nothing is queued.
+
+    block_time_ms set to 0 to wait indefinitely.
+*/
+bool scale_wait_for_latest_sample(QueueHandle_t subscriber, uint32_t block_time_ms, scale_measurement_t * sample) {
+    bool received = false;
 
+    while (xQueueReceive(subscriber, sample, 0) == pdTRUE) {
+        received = true;
+    }
+
+    if (received) {
         return true;
     }
-    
-    // No valid measurement
-    return false;
+
+    return scale_wait_for_next_sample(subscriber, block_time_ms, sample);
+}
+
+
+static uint64_t _get_rx_terminator_time_us() {
+    uint64_t timestamp_us;
+
+    // The 64 bit timestamp is written by the RX ISR and cannot be read atomically
+    do {
+        timestamp_us = scale_rx_terminator_time_us;
+    } while (timestamp_us != scale_rx_terminator_time_us);
+
+    return timestamp_us;
+}
+
+
+/*
+    Publish a decoded measurement to all subscribers. Called by the scale driver only.
+*/
+void scale_publish_measurement(const scale_reading_t * reading) {
+    scale_measurement_t sample = {
+        .weight = reading->weight,
+        .timestamp_us = _get_rx_terminator_time_us(),
+        .seq = scale_config.current_measurement.seq + 1,
+        .is_stable = reading->is_stable && !reading->is_overload,
+        .is_overload = reading->is_overload,
+        .unit = reading->unit,
+    };
+
+    taskENTER_CRITICAL();
+    scale_config.current_measurement = sample;
+    taskEXIT_CRITICAL();
+
+    for (uint8_t idx = 0; idx < scale_config.subscriber_count; idx += 1) {
+        QueueHandle_t subscriber = scale_config.subscribers[idx];
+
+        // Drop the oldest sample if the subscriber falls behind
+        if (xQueueSend(subscriber, &sample, 0) != pdTRUE) {
+            scale_measurement_t dropped_sample;
+            xQueueReceive(subscriber, &dropped_sample, 0);
+            xQueueSend(subscriber, &sample, 0);
+        }
+    }
 }
 
 
@@ -366,3 +540,61 @@ bool http_rest_scale_action(struct fs_file *file, int num_params, char *params[]
 
     return true;
 }
+
+
+bool http_rest_scale_telemetry(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings:
+    // t0 (array): samples since the last poll, each as [seq, timestamp_us, weight, is_stable, is_overload, unit]
+    // t1 (bool): the scale driver reports the stability, otherwise is_stable is always true
+
+    static char json_buffer[1024];
+
+    // Subscribe on the first poll so no samples are queued before anyone is listening
+    if (scale_telemetry_subscriber == NULL) {
+        scale_telemetry_subscriber = scale_subscribe(SCALE_TELEMETRY_DEPTH);
+    }
+
+    int len = snprintf(json_buffer, sizeof(json_buffer), "%s{\"t1\":%s,\"t0\":[",
+                       http_json_header,
+                       boolean_to_string(scale_config.scale_handle->reports_stability));
+
+    scale_measurement_t sample;
+    bool first = true;
+    while (scale_telemetry_subscriber && 
+           sizeof(json_buffer) - len > 80 && 
+           xQueueReceive(scale_telemetry_subscriber, &sample, 0) == pdTRUE) {
+        // Handle the special case
+        char weight_string[16];
+        if (isnan(sample.weight)) {
+            sprintf(weight_string, "\"nan\"");
+        }
+        else if (isinf(sample.weight)) {
+            sprintf(weight_string, "\"inf\"");
+        }
+        else {
+            sprintf(weight_string, "%0.3f", sample.weight);
+        }
+
+        len += snprintf(json_buffer + len, 
+                        sizeof(json_buffer) - len, 
+                        "%s[%" PRIu32 ",%" PRIu64 ",%s,%s,%s,\"%s\"]",
+                        first ? "" : ",",
+                        sample.seq,
+                        sample.timestamp_us,
+                        weight_string,
+                        boolean_to_string(sample.is_stable),
+                        boolean_to_string(sample.is_overload),
+                        get_scale_unit_string(sample.unit));
+        first = false;
+    }
+
+    snprintf(json_buffer + len, sizeof(json_buffer) - len, "]}");
+
+    size_t data_length = strlen(json_buffer);
+    file->data = json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
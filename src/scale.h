@@ -7,15 +7,28 @@
 #include "app.h"
 #include "http_rest.h"
 #include <semphr.h>
+#include <queue.h>
 
 #define EEPROM_SCALE_DATA_REV                     3              // 16 byte 
 
+#define SCALE_MAX_SUBSCRIBERS                     4
+
+
+// Frame layout and commands of a scale, see scale_protocol.h
+typedef struct scale_protocol_s scale_protocol_t;
+
 
 // Abstracted base class
 typedef struct {
     // Basic functions
     void (*read_loop_task)(void *self);
     void (*force_zero)(void);
+
+    // The frames carry a stability flag, otherwise every reading is published as stable
+    bool reports_stability;
+
+    // Protocol decoded by the read loop
+    const scale_protocol_t * protocol;
 } scale_handle_t;
 
 
@@ -51,6 +64,36 @@ typedef enum {
 } scale_action_t;
 
 
+typedef enum {
+    SCALE_UNIT_UNKNOWN = 0,         // The frame has no unit field or the unit is not recognised
+    SCALE_UNIT_GRAIN = 1,
+    SCALE_UNIT_GRAM = 2,
+    SCALE_UNIT_CARAT = 3,
+    SCALE_UNIT_OUNCE = 4,
+    SCALE_UNIT_POUND = 5,
+} scale_unit_t;
+
+
+// A frame decoded by the scale driver
+typedef struct {
+    float weight;                   // nan if the weight field does not decode
+    bool is_stable;
+    bool is_overload;               // Out of the range of the scale, the weight is not meaningful
+    scale_unit_t unit;
+} scale_reading_t;
+
+
+// A weight sample published by the active scale driver
+typedef struct {
+    float weight;
+    uint64_t timestamp_us;          // Arrival time of the frame terminator
+    uint32_t seq;                   // Increments by one on every published sample
+    bool is_stable;
+    bool is_overload;
+    scale_unit_t unit;
+} scale_measurement_t;
+
+
 typedef struct {
     uint16_t scale_data_rev;
     scale_driver_t scale_driver;
@@ -62,9 +105,13 @@ typedef struct {
 typedef struct {
     eeprom_scale_data_t persistent_config;
     scale_handle_t * scale_handle;
-    SemaphoreHandle_t scale_measurement_ready;
     SemaphoreHandle_t scale_serial_write_access_mutex;
-    float current_scale_measurement;
+    TaskHandle_t scale_listener_task_handler;
+
+    // Sample bus
+    scale_measurement_t current_measurement;
+    QueueHandle_t subscribers[SCALE_MAX_SUBSCRIBERS];
+    uint8_t subscriber_count;
 } scale_config_t;
 
 
@@ -76,7 +123,17 @@ extern "C" {
 bool scale_init();
 
 float scale_get_current_measurement();
-bool scale_block_wait_for_next_measurement(uint32_t block_time_ms, float * current_measurement);
+scale_measurement_t scale_get_latest_sample();
+
+// Sample bus
+QueueHandle_t scale_subscribe(uint8_t depth);
+bool scale_wait_for_next_sample(QueueHandle_t subscriber, uint32_t block_time_ms, scale_measurement_t * sample);
+bool scale_wait_for_latest_sample(QueueHandle_t subscriber, uint32_t block_time_ms, scale_measurement_t * sample);
+void scale_publish_measurement(const scale_reading_t * reading);
+
+// Decode the unit field of a frame, the surrounding white spaces are ignored
+scale_unit_t scale_parse_unit(const char * unit, size_t len);
+const char * get_scale_unit_string(scale_unit_t unit);
 
 void set_scale_driver(scale_driver_t scale_driver);
 
@@ -87,9 +144,14 @@ bool scale_config_save(void);
 // Low lever handler for writing data to the scale
 void scale_write(const char * command, size_t len);
 
+// Low level handlers for reading data from the scale (listener task only)
+bool scale_read_char(char * ch);
+bool scale_wait_for_data(uint32_t block_time_ms);
+
 // REST
 bool http_rest_scale_action(struct fs_file *file, int num_params, char *params[], char *values[]);
 bool http_rest_scale_config(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_scale_telemetry(struct fs_file *file, int num_params, char *params[], char *values[]);
 
 
 // Features
@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "scale_parser.h"
+
+
+static const float power_of_ten[SCALE_DECIMAL_MAX_DIGIT_CNT + 1] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f,
+};
+
+
+static inline bool is_digit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+
+size_t scale_parse_decimal(const char * str, size_t len, scale_decimal_t * decimal) {
+    size_t idx = 0;
+
+    // Leading spaces, the sign and the padding between the sign and the digits
+    while (idx < len && str[idx] == ' ') {
+        idx++;
+    }
+
+    bool is_negative = false;
+    if (idx < len && (str[idx] == '+' || str[idx] == '-')) {
+        is_negative = str[idx] == '-';
+        idx++;
+
+        while (idx < len && str[idx] == ' ') {
+            idx++;
+        }
+    }
+
+    // Accumulate the digits, leading zeros do not count towards the significant digits
+    uint32_t mantissa = 0;
+    uint8_t significant_digit_cnt = 0;
+    uint8_t decimal_cnt = 0;
+    bool has_digit = false;
+    bool has_point = false;
+
+    for (; idx < len; idx++) {
+        char ch = str[idx];
+
+        if (is_digit(ch)) {
+            has_digit = true;
+            if (mantissa != 0 || ch != '0') {
+                if (++significant_digit_cnt > SCALE_DECIMAL_MAX_DIGIT_CNT) {
+                    return 0;
+                }
+            }
+            mantissa = mantissa * 10 + (ch - '0');
+
+            if (has_point && ++decimal_cnt > SCALE_DECIMAL_MAX_DIGIT_CNT) {
+                return 0;
+            }
+        }
+        else if (ch == '.' && !has_point) {
+            has_point = true;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (!has_digit) {
+        return 0;
+    }
+
+    decimal->mantissa = is_negative ? -(int32_t) mantissa : (int32_t) mantissa;
+    decimal->decimal_cnt = decimal_cnt;
+
+    return idx;
+}
+
+
+size_t scale_skip_to_decimal(const char * str, size_t len) {
+    size_t idx = 0;
+
+    while (idx < len && !is_digit(str[idx]) && str[idx] != '+' && str[idx] != '-') {
+        idx++;
+    }
+
+    return idx;
+}
+
+
+float scale_decimal_to_float(const scale_decimal_t * decimal) {
+    return decimal->mantissa / power_of_ten[decimal->decimal_cnt];
+}
+
+
+float scale_parse_weight(const char * str, size_t len) {
+    scale_decimal_t decimal;
+
+    if (scale_parse_decimal(str, len, &decimal) == 0) {
+        return NAN;
+    }
+
+    return scale_decimal_to_float(&decimal);
+}
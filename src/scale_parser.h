@@ -0,0 +1,45 @@
+#ifndef SCALE_PARSER_H_
+#define SCALE_PARSER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+// Significant digits that fit in the mantissa, scales report 7 at most
+#define SCALE_DECIMAL_MAX_DIGIT_CNT     9
+
+
+// Decimal number decoded from a scale frame, the value is mantissa / 10^decimal_cnt
+typedef struct {
+    int32_t mantissa;
+    uint8_t decimal_cnt;            // Digits after the decimal point, as sent by the scale
+} scale_decimal_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    Parse "[spaces][+|-][spaces]digits[.digits]" from the start of a frame field. The field does not
+    have to be null terminated, parsing stops at the end of the field or at the first other character
+    (e.g. the unit). Independent of the locale and free of floating point.
+
+    Returns the number of characters consumed, or 0 if there is no digit or the number does not fit.
+*/
+size_t scale_parse_decimal(const char * str, size_t len, scale_decimal_t * decimal);
+
+// Index of the first sign or digit, skips a prefix like the "ST," header. Returns len if there is none.
+size_t scale_skip_to_decimal(const char * str, size_t len);
+
+float scale_decimal_to_float(const scale_decimal_t * decimal);
+
+// Parse a weight field, the weight is nan if the field does not decode
+float scale_parse_weight(const char * str, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SCALE_PARSER_H_
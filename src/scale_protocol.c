@@ -0,0 +1,351 @@
+#include <FreeRTOS.h>
+#include <task.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "scale.h"
+#include "scale_protocol.h"
+#include "scale_parser.h"
+
+
+extern scale_config_t scale_config;
+
+
+// Protocols of the supported scales, indexed by scale_driver_t. Adding a scale is adding an entry.
+static const scale_protocol_t scale_protocols[] = {
+    /*
+        A&D FX-i standard format: header, comma, 9 character data, 3 character unit
+        ST,+00012.34 GN
+        Header ST: stable, US: unstable, QT: stable (counting mode), OL: overload
+    */
+    [SCALE_DRIVER_AND_FXI] = {
+        .name = "AND FX-i Std",
+        .frame_len = 17,
+        .frame_end = '\n',
+        .weight = {.offset = 3, .len = 9},
+        .unit = {.offset = 12, .len = 3},
+        .status = {.offset = 0, .len = 2},
+        .stable_codes = "STQT",
+        .overload_codes = "OL",
+        .zero_command = "Z\r\n",
+        .tare_command = "T\r\n",
+        .print_command = "PRT\r\n",
+    },
+
+    /*
+        Steinberg SBS: S or SD header, 10 character signed data, space, unit
+        SD     -1.14 GN
+        The meaning of the D in the SD header is not documented
+    */
+    [SCALE_DRIVER_STEINBERG_SBS] = {
+        .name = "Steinberg SBS",
+        .frame_len = 17,
+        .frame_end = '\n',
+        .weight = {.offset = 2, .len = 10},
+        .unit = {.offset = 13, .len = 2},
+    },
+
+    /*
+        G&G JJB: sign, 7 character data, 3 character unit, only sent on request
+        The commands assume the C4 setting of the scale changed from ESC to !, see gng_scale.c
+    */
+    [SCALE_DRIVER_GNG_JJB] = {
+        .name = "GNG JJB",
+        .frame_len = 14,
+        .frame_end = '\n',
+        .sign = {.offset = 0, .len = 1},
+        .weight = {.offset = 2, .len = 7},
+        .unit = {.offset = 9, .len = 3},
+        .zero_command = "!t\r\n",
+        .tare_command = "!t\r\n",
+        .print_command = "!p\r\n",
+        .poll_period_ms = 250,
+    },
+
+    /*
+        US Solid JFDBS: sign, 8 character data, unit
+        +  320.344GN
+        Out of the range the data is filled with ~
+    */
+    [SCALE_DRIVER_USSOLID_JFDBS] = {
+        .name = "US Solid JFDBS",
+        .frame_len = 15,
+        .frame_end = '\n',
+        .sign = {.offset = 0, .len = 1},
+        .weight = {.offset = 2, .len = 8},
+        .unit = {.offset = 10, .len = 3},
+        .overload_fill = '~',
+    },
+
+    /*
+        JM Science FA: E header, stable state, sign, 9 character data, 3 character unit
+        The values of the stable state are not documented
+    */
+    [SCALE_DRIVER_JM_SCIENCE] = {
+        .name = "JM Science",
+        .frame_len = 19,
+        .frame_start = 'E',
+        .frame_end = '\n',
+        .sign = {.offset = 3, .len = 1},
+        .weight = {.offset = 4, .len = 9},
+        .unit = {.offset = 14, .len = 3},
+    },
+
+    /*
+        Creedmoor: sign, 7 character data with leading zeros, unit
+        +0142.02 GN
+    */
+    [SCALE_DRIVER_CREEDMOOR] = {
+        .name = "Creedmoor",
+        .frame_len = 14,
+        .frame_end = '\n',
+        .sign = {.offset = 0, .len = 1},
+        .weight = {.offset = 1, .len = 7},
+        .unit = {.offset = 9, .len = 2},
+    },
+
+    /*
+        Radwag PS R2 SUI response in continuous transmission (CU1): stability, 12 character mass, unit
+        SUI?       2.18 gr
+        Stability ' ': stable, '?': unstable, '^' / 'v': above / below the range
+        The force zero sends the tare command T
+    */
+    [SCALE_DRIVER_RADWAG_PS_R2] = {
+        .name = "Radwag PS R2",
+        .frame_len = 21,
+        .frame_end = '\n',
+        .header = {.offset = 0, .len = 3},
+        .header_text = "SUI",
+        .weight = {.offset = 4, .len = 12},
+        .unit = {.offset = 16, .len = 3},
+        .status = {.offset = 3, .len = 1},
+        .stable_codes = " ",
+        .overload_codes = "^v",
+        .zero_command = "T\r\n",
+        .tare_command = "T\r\n",
+    },
+
+    /*
+        Sartorius: optional sign, padded number, optional unit
+        +   62.916 GN
+    */
+    [SCALE_DRIVER_SARTORIUS] = {
+        .name = "Sartorius",
+    },
+
+    // Any line with a number, the prefix (e.g. "ST,") is skipped
+    [SCALE_DRIVER_GENERIC_DRV] = {
+        .name = "Generic Driver",
+    },
+};
+
+#define SCALE_PROTOCOL_CNT      (sizeof(scale_protocols) / sizeof(scale_protocols[0]))
+
+
+static void scale_protocol_force_zero(void);
+
+// Instance of the scale handle for the table driven scales
+static scale_handle_t scale_protocol_handle = {
+    .read_loop_task = scale_protocol_listener_task,
+    .force_zero = scale_protocol_force_zero,
+    .reports_stability = false,
+    .protocol = &scale_protocols[SCALE_DRIVER_AND_FXI],
+};
+
+
+const scale_protocol_t * scale_protocol_get(scale_driver_t scale_driver) {
+    if ((size_t) scale_driver >= SCALE_PROTOCOL_CNT || scale_protocols[scale_driver].name == NULL) {
+        return NULL;
+    }
+
+    return &scale_protocols[scale_driver];
+}
+
+
+scale_handle_t * scale_protocol_select(scale_driver_t scale_driver) {
+    const scale_protocol_t * protocol = scale_protocol_get(scale_driver);
+    if (protocol == NULL) {
+        protocol = &scale_protocols[SCALE_DRIVER_AND_FXI];
+    }
+
+    scale_protocol_handle.protocol = protocol;
+    scale_protocol_handle.reports_stability = protocol->status.len > 0;
+
+    return &scale_protocol_handle;
+}
+
+
+static void scale_protocol_force_zero(void) {
+    const char * command = scale_protocol_handle.protocol->zero_command;
+
+    if (command) {
+        scale_write(command, strlen(command));
+    }
+}
+
+
+void scale_protocol_rx_reset(scale_protocol_rx_t * rx) {
+    rx->len = 0;
+    rx->is_overflow = false;
+}
+
+
+size_t scale_protocol_receive(const scale_protocol_t * protocol, scale_protocol_rx_t * rx, char ch) {
+    size_t frame_len = 0;
+
+    // Lines
+    if (protocol->frame_len == 0) {
+        if (ch == '\r' || ch == '\n') {
+            // The CR of a CR LF terminator leaves an empty line
+            if (!rx->is_overflow) {
+                frame_len = rx->len;
+            }
+            scale_protocol_rx_reset(rx);
+        }
+        else if (rx->is_overflow) {
+            // Wait for the terminator
+        }
+        else if (rx->len < sizeof(rx->frame)) {
+            rx->frame[rx->len++] = ch;
+        }
+        else {
+            rx->is_overflow = true;
+        }
+
+        return frame_len;
+    }
+
+    // Fixed length frames
+    if (protocol->frame_start && ch == protocol->frame_start) {
+        rx->len = 0;
+    }
+
+    rx->frame[rx->len++] = ch;
+
+    // A frame that does not end on the terminator is out of sync, dropped
+    if (rx->len >= protocol->frame_len) {
+        if (protocol->frame_end == '\0' || ch == protocol->frame_end) {
+            frame_len = rx->len;
+        }
+        rx->len = 0;
+    }
+
+    // Restart after the terminator to resync if out of sync
+    if (protocol->frame_end && ch == protocol->frame_end) {
+        rx->len = 0;
+    }
+
+    return frame_len;
+}
+
+
+// The status field is one of the codes, each code is as long as the field
+static bool match_status_code(const char * codes, const char * status, size_t len) {
+    if (codes == NULL) {
+        return false;
+    }
+
+    for (; *codes; codes += len) {
+        if (memcmp(codes, status, len) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool scale_protocol_decode(const scale_protocol_t * protocol, const char * frame, size_t len, scale_reading_t * reading) {
+    reading->is_stable = true;
+    reading->is_overload = false;
+    reading->unit = SCALE_UNIT_UNKNOWN;
+
+    // Lines: the first number after any prefix, then the optional unit
+    if (protocol->frame_len == 0) {
+        size_t start = scale_skip_to_decimal(frame, len);
+
+        scale_decimal_t decimal;
+        size_t consumed = scale_parse_decimal(frame + start, len - start, &decimal);
+        if (consumed == 0) {
+            return false;
+        }
+
+        reading->weight = scale_decimal_to_float(&decimal);
+        reading->unit = scale_parse_unit(frame + start + consumed, len - start - consumed);
+
+        return true;
+    }
+
+    if (len != protocol->frame_len) {
+        return false;
+    }
+
+    if (protocol->header.len && memcmp(frame + protocol->header.offset, protocol->header_text, protocol->header.len) != 0) {
+        return false;
+    }
+
+    if (protocol->status.len) {
+        const char * status = frame + protocol->status.offset;
+        reading->is_stable = match_status_code(protocol->stable_codes, status, protocol->status.len);
+        reading->is_overload = match_status_code(protocol->overload_codes, status, protocol->status.len);
+    }
+
+    const char * weight = frame + protocol->weight.offset;
+    reading->weight = scale_parse_weight(weight, protocol->weight.len);
+
+    if (protocol->overload_fill && memchr(weight, protocol->overload_fill, protocol->weight.len)) {
+        reading->is_overload = true;
+    }
+
+    if (protocol->sign.len && frame[protocol->sign.offset] == '-') {
+        reading->weight = -reading->weight;
+    }
+
+    if (protocol->unit.len) {
+        reading->unit = scale_parse_unit(frame + protocol->unit.offset, protocol->unit.len);
+    }
+
+    return true;
+}
+
+
+void scale_protocol_listener_task(void * p) {
+    const scale_protocol_t * protocol = NULL;
+    scale_protocol_rx_t rx;
+    TickType_t last_request_tick = 0;
+
+    while (true) {
+        // The driver is changed from the settings, start over with the new protocol
+        if (protocol != scale_config.scale_handle->protocol) {
+            protocol = scale_config.scale_handle->protocol;
+            scale_protocol_rx_reset(&rx);
+            last_request_tick = xTaskGetTickCount() - pdMS_TO_TICKS(protocol->poll_period_ms);
+        }
+
+        // Wait for the RX interrupt to report a complete line, or until the next request is due
+        uint32_t block_time_ms = 0;
+        if (protocol->poll_period_ms) {
+            uint32_t elapsed_ms = pdTICKS_TO_MS(xTaskGetTickCount() - last_request_tick);
+            if (elapsed_ms >= protocol->poll_period_ms) {
+                scale_write(protocol->print_command, strlen(protocol->print_command));
+                last_request_tick = xTaskGetTickCount();
+                elapsed_ms = 0;
+            }
+
+            block_time_ms = protocol->poll_period_ms - elapsed_ms;
+        }
+        scale_wait_for_data(block_time_ms);
+
+        // Read all data
+        char ch;
+        while (scale_read_char(&ch)) {
+            size_t frame_len = scale_protocol_receive(protocol, &rx, ch);
+
+            scale_reading_t reading;
+            if (frame_len && scale_protocol_decode(protocol, rx.frame, frame_len, &reading)) {
+                scale_publish_measurement(&reading);
+            }
+        }
+    }
+}
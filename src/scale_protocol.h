@@ -0,0 +1,95 @@
+#ifndef SCALE_PROTOCOL_H_
+#define SCALE_PROTOCOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "scale.h"
+
+
+// Longest line of the scales without a fixed frame length, longer lines are dropped
+#define SCALE_PROTOCOL_MAX_FRAME_LEN    32
+
+
+// Position of a field in a frame, a field of zero length is not part of the frame
+typedef struct {
+    uint8_t offset;
+    uint8_t len;
+} scale_field_t;
+
+
+/*
+    Declarative description of the serial protocol of a scale, decoded by the shared listener task.
+
+    Fixed length frames are decoded once frame_len characters are received. The receive restarts after
+    the frame_end character (usually the \n of the terminator) and on the frame_start character (a header
+    that does not appear elsewhere in the frame), so a lost byte costs a single frame.
+
+    Frames with frame_len of 0 are lines terminated by \r or \n. The weight is the first number of the
+    line after any prefix, followed by the optional unit. Lines without a number are ignored.
+*/
+struct scale_protocol_s {
+    const char * name;
+
+    // Framing
+    uint8_t frame_len;                  // Including the terminator, 0 for a line
+    char frame_start;                   // '\0' if none
+    char frame_end;                     // '\0' if none
+
+    // Fixed length frame fields
+    scale_field_t header;               // Frames with another header are replies to other commands, ignored
+    const char * header_text;
+    scale_field_t sign;                 // A '-' negates the weight, for a sign sent apart from the digits
+    scale_field_t weight;
+    scale_field_t unit;
+    char overload_fill;                 // Out of the range the weight field is filled with this character
+
+    // Stability, the frames are reported stable if the scale has no status field
+    scale_field_t status;
+    const char * stable_codes;          // Status codes of status.len characters each, concatenated
+    const char * overload_codes;
+
+    // Commands, NULL if unsupported
+    const char * zero_command;
+    const char * tare_command;
+    const char * print_command;
+
+    // Scales that only report on request are sent the print command at this period
+    uint16_t poll_period_ms;
+};
+
+
+// Receive state of the shared listener
+typedef struct {
+    char frame[SCALE_PROTOCOL_MAX_FRAME_LEN];
+    uint8_t len;
+    bool is_overflow;                   // The line is too long, dropped up to the next terminator
+} scale_protocol_rx_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Protocol of the driver, NULL if the driver is unknown
+const scale_protocol_t * scale_protocol_get(scale_driver_t scale_driver);
+
+// Handle decoding the protocol of the driver, unknown drivers fall back to the A&D FX-i
+scale_handle_t * scale_protocol_select(scale_driver_t scale_driver);
+
+void scale_protocol_rx_reset(scale_protocol_rx_t * rx);
+
+// Add a received character. Returns the length of the frame in rx->frame once complete, otherwise 0.
+size_t scale_protocol_receive(const scale_protocol_t * protocol, scale_protocol_rx_t * rx, char ch);
+
+// Decode a complete frame, returns false if the frame carries no reading
+bool scale_protocol_decode(const scale_protocol_t * protocol, const char * frame, size_t len, scale_reading_t * reading);
+
+void scale_protocol_listener_task(void * p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SCALE_PROTOCOL_H_
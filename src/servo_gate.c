@@ -83,6 +83,16 @@ void servo_gate_set_ratio(gate_ratio_t ratio, bool block_wait) {
     }
 }
 
+bool servo_gate_is_move_complete(void) {
+    // The semaphore is given once the move completes, give it back so the state stays readable
+    if (xSemaphoreTake(servo_gate.move_ready_semphore, 0) == pdTRUE) {
+        xSemaphoreGive(servo_gate.move_ready_semphore);
+        return true;
+    }
+
+    return false;
+}
+
 void servo_gate_control_task(void *p) {
     (void)p;
 
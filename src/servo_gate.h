@@ -77,6 +77,9 @@ const char * gate_state_to_string(gate_state_t);
 // NEW:
 void servo_gate_set_ratio(float ratio, bool block_wait);
 
+// Non blocking check that the last move has completed
+bool servo_gate_is_move_complete(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,205 @@
+"""
+Charge performance benchmark. Runs a fixed matrix of powders x targets x profiles through the charge
+simulator and writes the results to a JSON file. Every cell starts from an untrained profile model.
+
+Usage
+
+    python charge_bench.py --sim build_sim/charge_sim --output charge_bench.json
+    python charge_bench.py --sim build_sim/charge_sim --output charge_bench.json --baseline bench_baseline.json
+
+With --baseline the script exits with 1 if the charge time or the accuracy regresses beyond the
+allowed margins, so a PID or threshold change can be judged before it reaches the loading bench.
+"""
+
+import argparse
+import concurrent.futures
+import csv
+import io
+import json
+import math
+import os
+import subprocess
+import sys
+
+
+script_directory = os.path.dirname(os.path.realpath(__file__))
+default_baseline_path = os.path.join(script_directory, 'bench_baseline.json')
+
+POWDERS = ['ball', 'extruded', 'stick']
+TARGETS = [24.0, 42.5, 75.0]
+PROFILES = [0, 1, 2, 3]
+
+CHARGES_PER_CELL = 20
+SEED = 1
+TOLERANCE = 0.04
+
+# Error histogram bin edges, overthrow is positive
+HISTOGRAM_EDGES = [-0.10, -0.06, -0.04, -0.02, 0.0, 0.02, 0.04, 0.06, 0.10]
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    idx = min(len(ordered) - 1, max(0, math.ceil(p * len(ordered)) - 1))
+    return ordered[idx]
+
+
+def histogram(errors):
+    labels = ['<{:+.2f}'.format(HISTOGRAM_EDGES[0])]
+    labels += ['{:+.2f}..{:+.2f}'.format(lo, hi) for lo, hi in zip(HISTOGRAM_EDGES, HISTOGRAM_EDGES[1:])]
+    labels += ['>={:+.2f}'.format(HISTOGRAM_EDGES[-1])]
+
+    counts = [0] * len(labels)
+    for error in errors:
+        bin_idx = 0
+        while bin_idx < len(HISTOGRAM_EDGES) and error >= HISTOGRAM_EDGES[bin_idx]:
+            bin_idx += 1
+        counts[bin_idx] += 1
+
+    return dict(zip(labels, counts))
+
+
+def summarize(rows):
+    errors = [row['error'] for row in rows]
+    charge_times = [row['charge_time_s'] for row in rows]
+    total_cycle_time = sum(row['cycle_time_s'] for row in rows)
+    mean_error = sum(errors) / len(errors)
+
+    return {
+        'charges': len(rows),
+        'charge_time_mean_s': round(sum(charge_times) / len(charge_times), 3),
+        'charge_time_p95_s': round(percentile(charge_times, 0.95), 3),
+        'charges_per_hour': round(3600.0 * len(rows) / total_cycle_time, 1),
+        'error_mean': round(mean_error, 4),
+        'error_sd': round(math.sqrt(sum((e - mean_error) ** 2 for e in errors) / len(errors)), 4),
+        'overthrow_cnt': sum(1 for e in errors if e > TOLERANCE),
+        'underthrow_cnt': sum(1 for e in errors if e < -TOLERANCE),
+        'within_tolerance_pct': round(100.0 * sum(1 for e in errors if abs(e) <= TOLERANCE) / len(errors), 1),
+        'error_histogram': histogram(errors),
+    }
+
+
+def run_cell(sim_path, powder, target, profile, charges):
+    command = [sim_path,
+               '--powder', powder,
+               '--target', str(target),
+               '--profile', str(profile),
+               '--charges', str(charges),
+               '--seed', str(SEED),
+               '--tolerance', str(TOLERANCE)]
+    result = subprocess.run(command, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError('{} failed:\n{}'.format(' '.join(command), result.stdout + result.stderr))
+
+    csv_lines = [line for line in result.stdout.splitlines() if not line.startswith('#')]
+    rows = [{key: float(value) for key, value in row.items() if key != 'powder'}
+            for row in csv.DictReader(io.StringIO('\n'.join(csv_lines)))]
+
+    return rows
+
+
+def run_bench(sim_path, charges, jobs):
+    cells = [(powder, target, profile) for powder in POWDERS for target in TARGETS for profile in PROFILES]
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs) as executor:
+        futures = [executor.submit(run_cell, sim_path, powder, target, profile, charges) for powder, target, profile in cells]
+        cell_rows = [future.result() for future in futures]
+
+    results = {
+        'config': {
+            'powders': POWDERS,
+            'targets': TARGETS,
+            'profiles': PROFILES,
+            'charges_per_cell': charges,
+            'seed': SEED,
+            'tolerance': TOLERANCE,
+        },
+        'cells': [],
+    }
+
+    all_rows = []
+    for (powder, target, profile), rows in zip(cells, cell_rows):
+        cell = {'powder': powder, 'target': target, 'profile': profile}
+        cell.update(summarize(rows))
+        results['cells'].append(cell)
+        all_rows += rows
+
+    results['overall'] = summarize(all_rows)
+
+    return results
+
+
+def cell_key(cell):
+    return '{}/{}/{}'.format(cell['powder'], cell['target'], cell['profile'])
+
+
+def compare(results, baseline, time_margin_pct, accuracy_margin_pct):
+    """
+    Returns the list of regressions against the baseline. Charge time may grow by time_margin_pct percent,
+    the share of charges within tolerance may drop by accuracy_margin_pct percentage points.
+    """
+    regressions = []
+
+    def check(name, current, previous):
+        if current['charge_time_mean_s'] > previous['charge_time_mean_s'] * (1 + time_margin_pct / 100.0):
+            regressions.append('{}: mean charge time {:.2f} s -> {:.2f} s'.format(
+                name, previous['charge_time_mean_s'], current['charge_time_mean_s']))
+        if current['within_tolerance_pct'] < previous['within_tolerance_pct'] - accuracy_margin_pct:
+            regressions.append('{}: within tolerance {:.1f}% -> {:.1f}%'.format(
+                name, previous['within_tolerance_pct'], current['within_tolerance_pct']))
+
+    if results['config'] != baseline['config']:
+        regressions.append('benchmark configuration differs from the baseline')
+        return regressions
+
+    check('overall', results['overall'], baseline['overall'])
+
+    baseline_cells = {cell_key(cell): cell for cell in baseline['cells']}
+    for cell in results['cells']:
+        previous = baseline_cells.get(cell_key(cell))
+        if previous:
+            check(cell_key(cell), cell, previous)
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Charge performance benchmark')
+    parser.add_argument('--sim', required=True, help='path to the charge_sim executable')
+    parser.add_argument('--output', default='charge_bench.json', help='result file')
+    parser.add_argument('--baseline', help='compare against this result file, use "default" for the committed baseline')
+    parser.add_argument('--charges', type=int, default=CHARGES_PER_CELL, help='charges per cell')
+    parser.add_argument('--jobs', type=int, default=os.cpu_count(), help='cells simulated in parallel')
+    parser.add_argument('--time-margin', type=float, default=5.0, help='allowed charge time increase in percent')
+    parser.add_argument('--accuracy-margin', type=float, default=5.0, help='allowed drop of the within tolerance share in percentage points')
+    args = parser.parse_args()
+
+    results = run_bench(args.sim, args.charges, args.jobs)
+
+    with open(args.output, 'w') as f:
+        json.dump(results, f, indent=2)
+        f.write('\n')
+
+    overall = results['overall']
+    print('charges: {}, charge time mean: {:.2f} s, p95: {:.2f} s, charges per hour: {:.1f}, within +/-{}: {:.1f}%'.format(
+        overall['charges'], overall['charge_time_mean_s'], overall['charge_time_p95_s'],
+        overall['charges_per_hour'], TOLERANCE, overall['within_tolerance_pct']))
+
+    if args.baseline:
+        baseline_path = default_baseline_path if args.baseline == 'default' else args.baseline
+        with open(baseline_path) as f:
+            baseline = json.load(f)
+
+        regressions = compare(results, baseline, args.time_margin, args.accuracy_margin)
+        for regression in regressions:
+            print('REGRESSION ' + regression)
+
+        if regressions:
+            return 1
+
+        print('No regression against {}'.format(baseline_path))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,521 @@
+/*
+    Runs the charge mode of the firmware against a simulated powder plant and scale, on a virtual
+    clock. The firmware sources are compiled unmodified for the host, see README.md.
+
+    Output: one CSV line per charge followed by a summary. The firmware console output is discarded
+    unless --verbose is given.
+*/
+#include <algorithm>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "autotune_mode.h"
+#include "charge_batch.h"
+#include "charge_mode.h"
+#include "eeprom.h"
+#include "mini_12864_module.h"
+#include "profile.h"
+#include "scale.h"
+
+#include "powder_plant.h"
+#include "sim.h"
+
+
+#define SIM_TIME_LIMIT_PER_CHARGE_US    (120 * 1000000ULL)
+
+// Powder still in flight when the tricklers stop on a scale overload
+#define SIM_OVERLOAD_STOP_MARGIN        2.0f
+
+
+typedef struct {
+    uint8_t profile_idx;
+    float target_weight;
+    uint32_t charge_cnt;
+    uint32_t seed;
+    const powder_t * powder;
+    scale_model_t scale;
+
+    bool predictive_stop_enable;
+    bool adaptive_coarse_stop_enable;
+    bool bulk_charge_enable;
+    float coarse_feed_forward_time_s;   // Negative to keep the profile setting
+    float fine_feed_forward_time_s;
+    bool autotune_enable;               // Run the autotune mode before the charges
+    std::vector<float> batch_targets;   // Charge the targets in a batch, --charges charges each
+
+    uint32_t cup_removal_delay_ms;      // Operator reaction time to the LED
+    uint32_t cup_return_delay_ms;       // Time to empty the cup and put it back
+    float tolerance;
+
+    bool verbose;
+} sim_options_t;
+
+
+typedef struct {
+    float target_weight;
+    float thrown_weight;
+    float error;
+    float charge_time_s;                // Charge start to the trickler stop
+    float cycle_time_s;                 // Charge start to the next charge start
+
+    // Profile model after the charge
+    float fine_stop_delay_s;
+    float coarse_stop_threshold;
+    float coarse_weight_per_rev;
+} charge_result_t;
+
+
+extern charge_mode_config_t charge_mode_config;
+extern eeprom_profile_model_data_t profile_model_data;
+extern autotune_mode_config_t autotune_mode_config;
+extern QueueHandle_t encoder_event_queue;
+
+static sim_options_t sim_options = {
+    .profile_idx = 0,
+    .target_weight = 40.0f,
+    .charge_cnt = 20,
+    .seed = 1,
+    .powder = &powder_presets[0],
+    .scale = default_scale_model,
+    .predictive_stop_enable = true,
+    .adaptive_coarse_stop_enable = true,
+    .bulk_charge_enable = false,
+    .coarse_feed_forward_time_s = -1.0f,
+    .fine_feed_forward_time_s = -1.0f,
+    .autotune_enable = false,
+    .batch_targets = {},
+    .cup_removal_delay_ms = 1000,
+    .cup_return_delay_ms = 2000,
+    .tolerance = 0.04f,
+    .verbose = false,
+};
+
+static PowderPlant * plant = NULL;
+static std::vector<charge_result_t> charge_results;
+static FILE * report = NULL;
+static volatile bool operator_done = false;
+
+
+static void world_tick(uint64_t now_us) {
+    plant->step(now_us, 0.001f);
+}
+
+
+static uint32_t get_total_charge_cnt() {
+    if (sim_options.batch_targets.empty()) {
+        return sim_options.charge_cnt;
+    }
+
+    return sim_options.charge_cnt * sim_options.batch_targets.size();
+}
+
+
+static void wait_for_charge_mode_state(charge_mode_state_t state) {
+    while (charge_mode_config.charge_mode_state != state) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+
+static void operator_task(void * p) {
+    (void) p;
+
+    uint64_t charge_start_us = 0;
+    bool batch_enable = !sim_options.batch_targets.empty();
+    uint32_t total_charge_cnt = get_total_charge_cnt();
+
+    for (uint32_t charge_idx = 0; charge_idx < total_charge_cnt; charge_idx += 1) {
+        wait_for_charge_mode_state(CHARGE_MODE_WAIT_FOR_COMPLETE);
+        uint64_t next_charge_start_us = time_us_64();
+        float target_weight = charge_mode_config.target_charge_weight;
+
+        // Complete the cycle time of the previous charge
+        if (charge_idx > 0) {
+            charge_results.back().cycle_time_s = (next_charge_start_us - charge_start_us) / 1e6f;
+        }
+        charge_start_us = next_charge_start_us;
+
+        wait_for_charge_mode_state(CHARGE_MODE_WAIT_FOR_CUP_REMOVAL);
+        uint64_t charge_stop_us = time_us_64();
+
+        vTaskDelay(pdMS_TO_TICKS(sim_options.cup_removal_delay_ms));
+
+        // Everything still falling ends up in the cup
+        charge_result_t result;
+        result.target_weight = target_weight;
+        result.thrown_weight = plant->get_pan_weight() + plant->get_in_flight_weight();
+        result.error = result.thrown_weight - target_weight;
+        result.charge_time_s = (charge_stop_us - charge_start_us) / 1e6f;
+        result.cycle_time_s = NAN;
+
+        profile_model_t * model = &profile_model_data.models[sim_options.profile_idx];
+        result.fine_stop_delay_s = model->fine_stop_delay_s;
+        result.coarse_stop_threshold = model->coarse_stop_threshold;
+        result.coarse_weight_per_rev = model->coarse_weight_per_rev;
+        charge_results.push_back(result);
+
+        plant->lift_cup();
+
+        // The charge mode leaves by itself once the batch is complete
+        if (batch_enable && charge_idx + 1 == total_charge_cnt) {
+            break;
+        }
+
+        wait_for_charge_mode_state(CHARGE_MODE_WAIT_FOR_CUP_RETURN);
+        vTaskDelay(pdMS_TO_TICKS(sim_options.cup_return_delay_ms));
+        plant->return_empty_cup();
+    }
+
+    // Let the last cycle complete then leave the charge mode
+    if (batch_enable) {
+        wait_for_charge_mode_state(CHARGE_MODE_EXIT);
+        charge_results.back().cycle_time_s = (time_us_64() - charge_start_us) / 1e6f;
+    }
+    else {
+        wait_for_charge_mode_state(CHARGE_MODE_WAIT_FOR_COMPLETE);
+        charge_results.back().cycle_time_s = (time_us_64() - charge_start_us) / 1e6f;
+
+        ButtonEncoderEvent_t button_encoder_event = BUTTON_RST_PRESSED;
+        xQueueSend(encoder_event_queue, &button_encoder_event, portMAX_DELAY);
+    }
+
+    operator_done = true;
+    vTaskDelete(NULL);
+}
+
+
+/*
+    Empty the cup once the autotune experiments are done, then leave the autotune mode.
+*/
+static void autotune_operator_task(void * p) {
+    (void) p;
+
+    while (autotune_mode_config.autotune_step != AUTOTUNE_STEP_COMPLETE &&
+           autotune_mode_config.autotune_step != AUTOTUNE_STEP_FAILED) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    plant->lift_cup();
+    vTaskDelay(pdMS_TO_TICKS(sim_options.cup_return_delay_ms));
+    plant->return_empty_cup();
+
+    ButtonEncoderEvent_t button_encoder_event = BUTTON_ENCODER_PRESSED;
+    xQueueSend(encoder_event_queue, &button_encoder_event, portMAX_DELAY);
+
+    vTaskDelete(NULL);
+}
+
+
+static void sim_main_task(void * p) {
+    (void) p;
+
+    encoder_event_queue = xQueueCreate(5, sizeof(ButtonEncoderEvent_t));
+
+    if (!profile_data_init() || !charge_mode_config_init() || !charge_batch_init() || !scale_init()) {
+        fprintf(report, "Unable to initialize the firmware modules\n");
+        sim_stop();
+        vTaskDelete(NULL);
+    }
+
+    profile_select(sim_options.profile_idx);
+    profile_model_t * model = profile_get_selected_model();
+    if (sim_options.coarse_feed_forward_time_s >= 0) {
+        model->coarse_feed_forward_time_s = sim_options.coarse_feed_forward_time_s;
+    }
+    if (sim_options.fine_feed_forward_time_s >= 0) {
+        model->fine_feed_forward_time_s = sim_options.fine_feed_forward_time_s;
+    }
+    profile_model_data.predictive_stop_enable = sim_options.predictive_stop_enable;
+    profile_model_data.adaptive_coarse_stop_enable = sim_options.adaptive_coarse_stop_enable;
+    profile_model_data.bulk_charge_enable = sim_options.bulk_charge_enable;
+    charge_mode_config.target_charge_weight = sim_options.target_weight;
+
+    for (float target_weight : sim_options.batch_targets) {
+        charge_batch_add(target_weight, sim_options.profile_idx, sim_options.charge_cnt);
+    }
+    if (!sim_options.batch_targets.empty()) {
+        charge_batch_start();
+    }
+
+    if (sim_options.autotune_enable) {
+        xTaskCreate(autotune_operator_task, "Autotune Operator Task", configMINIMAL_STACK_SIZE, NULL, 8, NULL);
+        autotune_mode_menu();
+    }
+
+    xTaskCreate(operator_task, "Operator Task", configMINIMAL_STACK_SIZE, NULL, 8, NULL);
+
+    // Same priority as the menu task
+    charge_mode_menu(true);
+
+    // A batch leaves the charge mode by itself, let the operator record the last cycle
+    while (!operator_done) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    sim_stop();
+    vTaskDelete(NULL);
+}
+
+
+static float percentile(std::vector<float> values, float p) {
+    std::sort(values.begin(), values.end());
+
+    size_t idx = std::min(values.size() - 1, (size_t) ceilf(p * values.size()) - 1);
+    return values[idx];
+}
+
+
+static void print_charge_results() {
+    fprintf(report, "charge,profile,powder,target,thrown,error,charge_time_s,cycle_time_s,fine_stop_delay_s,coarse_stop_threshold,coarse_weight_per_rev\n");
+
+    for (size_t idx = 0; idx < charge_results.size(); idx += 1) {
+        const charge_result_t & result = charge_results[idx];
+
+        fprintf(report, "%zu,%u,%s,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                idx,
+                sim_options.profile_idx,
+                sim_options.powder->name,
+                result.target_weight,
+                result.thrown_weight,
+                result.error,
+                result.charge_time_s,
+                result.cycle_time_s,
+                result.fine_stop_delay_s,
+                result.coarse_stop_threshold,
+                result.coarse_weight_per_rev);
+    }
+}
+
+
+static void print_summary() {
+    std::vector<float> charge_times;
+    float sum_error = 0.0f, sum_error_squares = 0.0f, max_abs_error = 0.0f;
+    float sum_charge_time = 0.0f, sum_cycle_time = 0.0f;
+    uint32_t in_tolerance_cnt = 0;
+
+    for (const charge_result_t & result : charge_results) {
+        charge_times.push_back(result.charge_time_s);
+        sum_error += result.error;
+        sum_error_squares += result.error * result.error;
+        max_abs_error = fmaxf(max_abs_error, fabsf(result.error));
+        sum_charge_time += result.charge_time_s;
+        sum_cycle_time += result.cycle_time_s;
+
+        if (fabsf(result.error) <= sim_options.tolerance) {
+            in_tolerance_cnt += 1;
+        }
+    }
+
+    size_t n = charge_results.size();
+    float mean_error = sum_error / n;
+
+    fprintf(report, "# charges: %zu\n", n);
+    fprintf(report, "# error mean: %.3f sd: %.3f max: %.3f\n", mean_error, sqrtf(fmaxf(0.0f, sum_error_squares / n - mean_error * mean_error)), max_abs_error);
+    fprintf(report, "# within +/-%.3f: %lu (%.1f%%)\n", sim_options.tolerance, (unsigned long) in_tolerance_cnt, 100.0f * in_tolerance_cnt / n);
+    fprintf(report, "# charge time mean: %.2f s p95: %.2f s\n", sum_charge_time / n, percentile(charge_times, 0.95f));
+    fprintf(report, "# charges per hour: %.1f\n", 3600.0f * n / sum_cycle_time);
+
+    // Phase breakdown of the recent charges, as reported by /rest/charge_timing
+    struct fs_file file;
+    http_rest_charge_timing(&file, 0, NULL, NULL);
+    fprintf(report, "# charge timing: %s\n", file.data + strlen(http_json_header));
+
+    // Experiment results and gains, as reported by /rest/autotune_mode_state
+    if (sim_options.autotune_enable) {
+        http_rest_autotune_mode_state(&file, 0, NULL, NULL);
+        fprintf(report, "# autotune: %s\n", file.data + strlen(http_json_header));
+    }
+
+    // Queue and results, as reported by /rest/charge_batch
+    if (!sim_options.batch_targets.empty()) {
+        http_rest_charge_batch(&file, 0, NULL, NULL);
+        fprintf(report, "# batch: %s\n", file.data + strlen(http_json_header));
+    }
+
+    // Flow learned by the profile, as reported by /rest/profile_flow_model
+    http_rest_profile_flow_model(&file, 0, NULL, NULL);
+    fprintf(report, "# flow model: %s\n", file.data + strlen(http_json_header));
+}
+
+
+static void print_usage(const char * name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --profile IDX         profile index (default 0)\n"
+            "  --target WEIGHT       target charge weight (default 40)\n"
+            "  --charges N           number of charges (default 20)\n"
+            "  --seed N              random seed (default 1)\n"
+            "  --powder NAME         ball, extruded or stick (default ball)\n"
+            "  --sample-rate HZ      scale report rate (default 10)\n"
+            "  --filter-tau S        scale response time constant (default 0.15)\n"
+            "  --scale-noise SD      scale noise (default 0.004)\n"
+            "  --scale-capacity W    the scale reports an overload above W, the charges must stop there (default none)\n"
+            "  --no-predictive       disable the predictive fine stop\n"
+            "  --no-adaptive         disable the adaptive coarse stop\n"
+            "  --bulk-charge         throw the bulk of the charge by counted coarse trickler revolutions\n"
+            "  --coarse-ff S         coarse trickler feed-forward time budget, 0 to disable (default profile)\n"
+            "  --fine-ff S           fine trickler feed-forward time budget, 0 to disable (default profile)\n"
+            "  --autotune            tune the PID gains of the profile with the autotune mode first\n"
+            "  --batch W1,W2,...     charge the targets in a batch, --charges charges each\n"
+            "  --tolerance WEIGHT    acceptable error for the summary (default 0.04)\n"
+            "  --verbose             show the firmware console output\n",
+            name);
+}
+
+
+static bool parse_options(int argc, char * argv[]) {
+    static const struct option long_options[] = {
+        {"profile", required_argument, NULL, 'p'},
+        {"target", required_argument, NULL, 't'},
+        {"charges", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 's'},
+        {"powder", required_argument, NULL, 'w'},
+        {"sample-rate", required_argument, NULL, 'r'},
+        {"filter-tau", required_argument, NULL, 'f'},
+        {"scale-noise", required_argument, NULL, 'z'},
+        {"scale-capacity", required_argument, NULL, 'c'},
+        {"no-predictive", no_argument, NULL, 'P'},
+        {"no-adaptive", no_argument, NULL, 'A'},
+        {"bulk-charge", no_argument, NULL, 'B'},
+        {"coarse-ff", required_argument, NULL, 'C'},
+        {"fine-ff", required_argument, NULL, 'F'},
+        {"autotune", no_argument, NULL, 'U'},
+        {"batch", required_argument, NULL, 'b'},
+        {"tolerance", required_argument, NULL, 'T'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p':
+                sim_options.profile_idx = atoi(optarg);
+                break;
+            case 't':
+                sim_options.target_weight = strtof(optarg, NULL);
+                break;
+            case 'n':
+                sim_options.charge_cnt = atoi(optarg);
+                break;
+            case 's':
+                sim_options.seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                sim_options.powder = find_powder_preset(optarg);
+                if (sim_options.powder == NULL) {
+                    fprintf(stderr, "Unknown powder: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case 'r':
+                sim_options.scale.sample_rate_hz = strtof(optarg, NULL);
+                break;
+            case 'f':
+                sim_options.scale.filter_tau_s = strtof(optarg, NULL);
+                break;
+            case 'z':
+                sim_options.scale.noise_sd = strtof(optarg, NULL);
+                break;
+            case 'c':
+                sim_options.scale.capacity = strtof(optarg, NULL);
+                break;
+            case 'P':
+                sim_options.predictive_stop_enable = false;
+                break;
+            case 'A':
+                sim_options.adaptive_coarse_stop_enable = false;
+                break;
+            case 'B':
+                sim_options.bulk_charge_enable = true;
+                break;
+            case 'C':
+                sim_options.coarse_feed_forward_time_s = strtof(optarg, NULL);
+                break;
+            case 'F':
+                sim_options.fine_feed_forward_time_s = strtof(optarg, NULL);
+                break;
+            case 'U':
+                sim_options.autotune_enable = true;
+                break;
+            case 'b':
+                for (char * token = strtok(optarg, ","); token != NULL; token = strtok(NULL, ",")) {
+                    sim_options.batch_targets.push_back(strtof(token, NULL));
+                }
+                break;
+            case 'T':
+                sim_options.tolerance = strtof(optarg, NULL);
+                break;
+            case 'v':
+                sim_options.verbose = true;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    if (sim_options.profile_idx >= MAX_PROFILE_CNT || sim_options.charge_cnt == 0 || sim_options.scale.sample_rate_hz <= 0 ||
+        sim_options.batch_targets.size() > CHARGE_BATCH_MAX_ENTRY_CNT) {
+        fprintf(stderr, "Invalid options\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+int main(int argc, char * argv[]) {
+    if (!parse_options(argc, argv)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // Keep the report on the original stdout and silence the firmware console
+    fflush(stdout);
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!sim_options.verbose) {
+        freopen("/dev/null", "w", stdout);
+    }
+
+    sim_eeprom_erase();
+
+    PowderPlant powder_plant(*sim_options.powder, sim_options.scale, sim_options.seed);
+    plant = &powder_plant;
+    sim_set_world_tick(world_tick);
+
+    xTaskCreate(sim_main_task, "Sim Main Task", configMINIMAL_STACK_SIZE, NULL, 6, NULL);
+    uint32_t total_charge_cnt = get_total_charge_cnt();
+    bool is_ok = sim_run(SIM_TIME_LIMIT_PER_CHARGE_US * (total_charge_cnt + (sim_options.autotune_enable ? 1 : 0)));
+
+    if (!is_ok || charge_results.size() != total_charge_cnt) {
+        fprintf(report, "# simulation incomplete: %zu of %lu charges\n", charge_results.size(), (unsigned long) total_charge_cnt);
+        fclose(report);
+        return 1;
+    }
+
+    print_charge_results();
+    print_summary();
+
+    // The tricklers stop on the first overload frame
+    int exit_code = 0;
+    for (size_t idx = 0; idx < charge_results.size() && sim_options.scale.capacity > 0; idx += 1) {
+        if (charge_results[idx].thrown_weight > sim_options.scale.capacity + SIM_OVERLOAD_STOP_MARGIN) {
+            fprintf(report, "# charge %zu not stopped on the scale overload: %.3f thrown\n", idx, charge_results[idx].thrown_weight);
+            exit_code = 1;
+        }
+    }
+
+    fclose(report);
+
+    return exit_code;
+}
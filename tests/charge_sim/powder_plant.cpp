@@ -0,0 +1,193 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "powder_plant.h"
+#include "sim.h"
+#include "configuration.h"
+
+
+// Correlation time of the flow variation
+#define FLOW_VARIATION_TAU_S    0.2f
+
+
+const powder_t powder_presets[] = {
+    // Small spherical kernels, meters evenly
+    {
+        .name = "ball",
+        .coarse_weight_per_rev = 8.0f,
+        .fine_weight_per_rev = 0.12f,
+        .flow_noise = 0.1f,
+        .kernel_weight = 0.004f,
+        .coarse_fall_time_s = 0.25f,
+        .fine_fall_time_s = 0.35f,
+    },
+    // Short cut extruded powder
+    {
+        .name = "extruded",
+        .coarse_weight_per_rev = 6.0f,
+        .fine_weight_per_rev = 0.1f,
+        .flow_noise = 0.3f,
+        .kernel_weight = 0.02f,
+        .coarse_fall_time_s = 0.3f,
+        .fine_fall_time_s = 0.4f,
+    },
+    // Long extruded kernels, bridges in the tube and falls in clumps
+    {
+        .name = "stick",
+        .coarse_weight_per_rev = 5.0f,
+        .fine_weight_per_rev = 0.08f,
+        .flow_noise = 0.6f,
+        .kernel_weight = 0.04f,
+        .coarse_fall_time_s = 0.35f,
+        .fine_fall_time_s = 0.5f,
+    },
+};
+const size_t powder_preset_cnt = sizeof(powder_presets) / sizeof(powder_presets[0]);
+
+
+// A&D FX-120i in grain mode, stream output
+const scale_model_t default_scale_model = {
+    .sample_rate_hz = 10.0f,
+    .filter_tau_s = 0.15f,
+    .resolution = 0.02f,
+    .noise_sd = 0.004f,
+    .cup_weight = 50.0f,
+    .capacity = 0.0f,
+};
+
+
+const powder_t * find_powder_preset(const char * name) {
+    for (size_t idx = 0; idx < powder_preset_cnt; idx += 1) {
+        if (strcmp(powder_presets[idx].name, name) == 0) {
+            return &powder_presets[idx];
+        }
+    }
+
+    return NULL;
+}
+
+
+PowderPlant::PowderPlant(const powder_t & powder, const scale_model_t & scale, uint32_t seed) :
+    powder(powder), scale(scale), rng(seed), unit_normal(0.0f, 1.0f) {
+    coarse_released_weight = 0.0f;
+    fine_released_weight = 0.0f;
+    flow_variation = 0.0f;
+
+    cup_on_scale = true;
+    pan_weight = 0.0f;
+
+    // Start with the cup tared
+    filtered_load = scale.cup_weight;
+    tare = scale.cup_weight;
+    next_report_time_s = 0.0;
+}
+
+
+void PowderPlant::release(float * released_weight, float rps, float weight_per_rev, float fall_time_s, double now_s, float dt_s) {
+    if (rps <= 0) {
+        return;
+    }
+
+    float flow = rps * weight_per_rev * fmaxf(0.0f, 1.0f + flow_variation);
+    *released_weight += flow * dt_s;
+
+    while (*released_weight >= powder.kernel_weight) {
+        *released_weight -= powder.kernel_weight;
+        falling_kernels.push_back({now_s + fall_time_s, powder.kernel_weight});
+    }
+}
+
+
+float PowderPlant::get_in_flight_weight() const {
+    float weight = 0.0f;
+
+    for (const falling_kernel_t & kernel : falling_kernels) {
+        weight += kernel.weight;
+    }
+
+    return weight;
+}
+
+
+void PowderPlant::lift_cup() {
+    cup_on_scale = false;
+}
+
+
+void PowderPlant::return_empty_cup() {
+    pan_weight = 0.0f;
+    cup_on_scale = true;
+}
+
+
+void PowderPlant::handle_scale_command(double now_s) {
+    (void) now_s;
+
+    char command[32];
+    size_t len = sim_uart_take_transmitted(SCALE_UART, command, sizeof(command) - 1);
+    command[len] = 0;
+
+    // Re-zero key
+    if (strstr(command, "Z\r\n")) {
+        tare = filtered_load;
+    }
+}
+
+
+void PowderPlant::report(double now_s) {
+    (void) now_s;
+
+    float reading = filtered_load - tare + scale.noise_sd * unit_normal(rng);
+    reading = roundf(reading / scale.resolution) * scale.resolution;
+
+    // The reading is stable once the filter output is within the last digit of the load
+    float load = cup_on_scale ? scale.cup_weight + pan_weight : 0.0f;
+    bool is_stable = fabsf(load - filtered_load) < scale.resolution * 0.5f;
+
+    char frame[32];
+    int len;
+    if (scale.capacity > 0 && reading > scale.capacity) {
+        len = snprintf(frame, sizeof(frame), "OL,+9999E+19 GN\r\n");
+    }
+    else {
+        len = snprintf(frame, sizeof(frame), "%s,%+09.2f GN\r\n", is_stable ? "ST" : "US", reading);
+    }
+
+    sim_uart_receive(SCALE_UART, frame, len);
+}
+
+
+void PowderPlant::step(uint64_t now_us, float dt_s) {
+    double now_s = now_us / 1e6;
+
+    sim_motor_step(dt_s);
+
+    // Flow varies slowly as the powder packs and bridges in the tube
+    flow_variation += -flow_variation * dt_s / FLOW_VARIATION_TAU_S +
+                      powder.flow_noise * sqrtf(2.0f * dt_s / FLOW_VARIATION_TAU_S) * unit_normal(rng);
+
+    release(&coarse_released_weight, sim_motor_get_speed(SELECT_COARSE_TRICKLER_MOTOR), powder.coarse_weight_per_rev, powder.coarse_fall_time_s, now_s, dt_s);
+    release(&fine_released_weight, sim_motor_get_speed(SELECT_FINE_TRICKLER_MOTOR), powder.fine_weight_per_rev, powder.fine_fall_time_s, now_s, dt_s);
+
+    // Land the kernels, the coarse and fine kernels may land out of order
+    for (auto it = falling_kernels.begin(); it != falling_kernels.end();) {
+        if (it->land_time_s <= now_s) {
+            pan_weight += it->weight;
+            it = falling_kernels.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    float load = cup_on_scale ? scale.cup_weight + pan_weight : 0.0f;
+    filtered_load += (load - filtered_load) * (1.0f - expf(-dt_s / scale.filter_tau_s));
+
+    handle_scale_command(now_s);
+
+    if (now_s >= next_report_time_s) {
+        report(now_s);
+        next_report_time_s += 1.0 / scale.sample_rate_hz;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef POWDER_PLANT_H_
+#define POWDER_PLANT_H_
+
+#include <stdint.h>
+#include <deque>
+#include <random>
+
+
+// Powder delivered by the tricklers
+typedef struct {
+    const char * name;
+
+    float coarse_weight_per_rev;    // Weight delivered by one revolution of the coarse trickler
+    float fine_weight_per_rev;      // Weight delivered by one revolution of the fine trickler
+    float flow_noise;               // Relative standard deviation of the flow
+    float kernel_weight;            // Powder leaves the trickler tube one kernel at a time
+
+    float coarse_fall_time_s;       // Time between leaving the trickler and landing on the pan
+    float fine_fall_time_s;
+} powder_t;
+
+
+// Scale attached to the controller, reports in A&D FX-i standard format
+typedef struct {
+    float sample_rate_hz;
+    float filter_tau_s;             // First order response of the load cell and the scale filter
+    float resolution;
+    float noise_sd;
+    float cup_weight;
+    float capacity;                 // Readings above are reported as an overload, 0 for no limit
+} scale_model_t;
+
+
+extern const powder_t powder_presets[];
+extern const size_t powder_preset_cnt;
+extern const scale_model_t default_scale_model;
+
+const powder_t * find_powder_preset(const char * name);
+
+
+class PowderPlant
+{
+private:
+    typedef struct {
+        double land_time_s;
+        float weight;
+    } falling_kernel_t;
+
+    powder_t powder;
+    scale_model_t scale;
+    std::mt19937 rng;
+    std::normal_distribution<float> unit_normal;
+
+    std::deque<falling_kernel_t> falling_kernels;
+    float coarse_released_weight;   // Weight left the tube but not yet formed a full kernel
+    float fine_released_weight;
+    float flow_variation;
+
+    bool cup_on_scale;
+    float pan_weight;               // Powder landed in the cup
+
+    float filtered_load;
+    float tare;
+    double next_report_time_s;
+
+    void release(float * released_weight, float rps, float weight_per_rev, float fall_time_s, double now_s, float dt_s);
+    void handle_scale_command(double now_s);
+    void report(double now_s);
+
+public:
+    PowderPlant(const powder_t & powder, const scale_model_t & scale, uint32_t seed);
+
+    // Advance the plant by dt_s and send the scale reports that fall in the step
+    void step(uint64_t now_us, float dt_s);
+
+    void lift_cup();
+    void return_empty_cup();
+
+    bool is_cup_on_scale() const { return cup_on_scale; }
+    float get_pan_weight() const { return pan_weight; }
+    float get_in_flight_weight() const;
+};
+
+#endif  // POWDER_PLANT_H_
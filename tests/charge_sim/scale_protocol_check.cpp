@@ -0,0 +1,236 @@
+/*
+    Checks the scale protocol table on the host: the frames of every supported scale from the parser
+    corpus (tests/scale_parser_bench/corpus) are received byte by byte and decoded through the protocol
+    of their driver, also after the stream is broken by a lost or a stray byte.
+
+    Exits non-zero if any check fails.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "scale.h"
+#include "scale_protocol.h"
+
+
+typedef struct {
+    scale_driver_t driver;
+    const char * corpus_file;
+} protocol_corpus_t;
+
+static const protocol_corpus_t protocol_corpora[] = {
+    {SCALE_DRIVER_AND_FXI, "and_fxi.txt"},
+    {SCALE_DRIVER_STEINBERG_SBS, "steinberg_sbs.txt"},
+    {SCALE_DRIVER_GNG_JJB, "gng_jjb.txt"},
+    {SCALE_DRIVER_USSOLID_JFDBS, "ussolid_jfdbs.txt"},
+    {SCALE_DRIVER_JM_SCIENCE, "jm_science.txt"},
+    {SCALE_DRIVER_CREEDMOOR, "creedmoor.txt"},
+    {SCALE_DRIVER_RADWAG_PS_R2, "radwag_ps_r2.txt"},
+    {SCALE_DRIVER_SARTORIUS, "sartorius.txt"},
+    {SCALE_DRIVER_GENERIC_DRV, "generic.txt"},
+};
+
+
+typedef struct {
+    std::string frame;
+    bool expect_number;
+    float expected;
+} corpus_frame_t;
+
+
+static int fail_cnt = 0;
+
+
+// Each line is "expected|frame", expected is nan if the frame carries no number. # starts a comment.
+static std::vector<corpus_frame_t> load_corpus(const char * corpus_file) {
+    std::vector<corpus_frame_t> frames;
+    std::string path = std::string(CORPUS_DIR) + "/" + corpus_file;
+
+    FILE * file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        printf("Unable to open %s\n", path.c_str());
+        fail_cnt++;
+        return frames;
+    }
+
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char * separator = strchr(line, '|');
+        if (line[0] == '#' || separator == NULL) {
+            continue;
+        }
+        *separator = '\0';
+
+        corpus_frame_t frame;
+        frame.frame = std::string(separator + 1) + "\r\n";
+        frame.expect_number = strcmp(line, "nan") != 0;
+        frame.expected = frame.expect_number ? strtof(line, NULL) : NAN;
+        frames.push_back(frame);
+    }
+
+    fclose(file);
+    return frames;
+}
+
+
+// Receive a stream, returns the readings decoded from it
+static std::vector<scale_reading_t> receive(const scale_protocol_t * protocol, const std::string & stream) {
+    std::vector<scale_reading_t> readings;
+    scale_protocol_rx_t rx;
+    scale_protocol_rx_reset(&rx);
+
+    for (char ch : stream) {
+        size_t frame_len = scale_protocol_receive(protocol, &rx, ch);
+
+        scale_reading_t reading;
+        if (frame_len && scale_protocol_decode(protocol, rx.frame, frame_len, &reading)) {
+            readings.push_back(reading);
+        }
+    }
+
+    return readings;
+}
+
+
+static bool matches(const scale_reading_t & reading, const corpus_frame_t & frame) {
+    if (!frame.expect_number) {
+        return isnan(reading.weight);
+    }
+
+    return fabsf(reading.weight - frame.expected) <= fabsf(frame.expected) * 1e-6f;
+}
+
+
+// Every frame decodes to its weight
+static void check_frames(const char * name, const scale_protocol_t * protocol, const std::vector<corpus_frame_t> & frames) {
+    for (const corpus_frame_t & frame : frames) {
+        std::vector<scale_reading_t> readings = receive(protocol, frame.frame);
+
+        // Lines without a number are not reported
+        bool is_ok = readings.empty() ? !frame.expect_number && protocol->frame_len == 0 :
+                                        readings.size() == 1 && matches(readings[0], frame);
+        if (!is_ok) {
+            printf("FAIL %s: \"%s\" gave %zu readings, expected %f\n", name, frame.frame.c_str(), readings.size(), frame.expected);
+            fail_cnt++;
+        }
+    }
+}
+
+
+// A frame with a lost or a stray byte is lost, the following frame decodes
+static void check_resync(const char * name, const scale_protocol_t * protocol, const std::vector<corpus_frame_t> & frames) {
+    for (size_t idx = 0; idx + 1 < frames.size(); idx++) {
+        const corpus_frame_t & next = frames[idx + 1];
+        if (!next.expect_number) {
+            continue;
+        }
+
+        std::string lost = frames[idx].frame;
+        lost.erase(lost.size() / 2, 1);
+        std::string stray = frames[idx].frame;
+        stray.insert(stray.size() / 2, "7");
+
+        for (const std::string & broken : {lost, stray}) {
+            std::vector<scale_reading_t> readings = receive(protocol, broken + next.frame);
+            // Fixed length frames out of sync are dropped, a line decodes to whatever number it holds
+            size_t max_reading_cnt = protocol->frame_len ? 1 : 2;
+            if (readings.empty() || readings.size() > max_reading_cnt || !matches(readings.back(), next)) {
+                printf("FAIL %s: no resync on \"%s\" after \"%s\"\n", name, next.frame.c_str(), broken.c_str());
+                fail_cnt++;
+            }
+        }
+    }
+}
+
+
+static void check_layout(const char * name, const scale_protocol_t * protocol) {
+    if (protocol->frame_len > SCALE_PROTOCOL_MAX_FRAME_LEN) {
+        printf("FAIL %s: frame of %u bytes\n", name, protocol->frame_len);
+        fail_cnt++;
+    }
+
+    if (protocol->frame_len == 0) {
+        return;
+    }
+
+    const scale_field_t fields[] = {protocol->header, protocol->sign, protocol->weight, protocol->unit, protocol->status};
+    for (const scale_field_t & field : fields) {
+        if (field.offset + field.len > protocol->frame_len) {
+            printf("FAIL %s: field at %u of %u bytes outside of the frame\n", name, field.offset, field.len);
+            fail_cnt++;
+        }
+    }
+
+    if (protocol->poll_period_ms && protocol->print_command == NULL) {
+        printf("FAIL %s: polled without a print command\n", name);
+        fail_cnt++;
+    }
+}
+
+
+// The status field sets the stability and the overload
+static void check_status() {
+    const scale_protocol_t * and_fxi = scale_protocol_get(SCALE_DRIVER_AND_FXI);
+    const scale_protocol_t * radwag = scale_protocol_get(SCALE_DRIVER_RADWAG_PS_R2);
+    const scale_protocol_t * ussolid = scale_protocol_get(SCALE_DRIVER_USSOLID_JFDBS);
+
+    const struct {
+        const scale_protocol_t * protocol;
+        const char * frame;
+        bool is_stable;
+        bool is_overload;
+    } cases[] = {
+        {and_fxi, "ST,+00012.34 GN\r\n", true, false},
+        {and_fxi, "QT,+00012.34 GN\r\n", true, false},
+        {and_fxi, "US,+00012.34 GN\r\n", false, false},
+        {and_fxi, "OL,+9999E+19 GN\r\n", false, true},
+        {radwag, "SUI        1.56 gr \r\n", true, false},
+        {radwag, "SUI?       2.18 gr \r\n", false, false},
+        {radwag, "SUI^    9999.99 gr \r\n", false, true},
+        {ussolid, "+ ~~~~~~~~GN \r\n", true, true},
+    };
+
+    for (const auto & entry : cases) {
+        std::vector<scale_reading_t> readings = receive(entry.protocol, entry.frame);
+        if (readings.size() != 1 || readings[0].is_stable != entry.is_stable || readings[0].is_overload != entry.is_overload) {
+            printf("FAIL %s: status of \"%s\"\n", entry.protocol->name, entry.frame);
+            fail_cnt++;
+        }
+    }
+
+    // Replies to other commands are ignored
+    if (!receive(radwag, "SIX        1.56 gr \r\n").empty()) {
+        printf("FAIL %s: frame with another header decoded\n", radwag->name);
+        fail_cnt++;
+    }
+}
+
+
+int main(int argc, char * argv[]) {
+    size_t frame_cnt = 0;
+
+    for (const protocol_corpus_t & corpus : protocol_corpora) {
+        const scale_protocol_t * protocol = scale_protocol_get(corpus.driver);
+        if (protocol == NULL) {
+            printf("FAIL driver %d has no protocol\n", corpus.driver);
+            fail_cnt++;
+            continue;
+        }
+
+        std::vector<corpus_frame_t> frames = load_corpus(corpus.corpus_file);
+        frame_cnt += frames.size();
+
+        check_layout(protocol->name, protocol);
+        check_frames(protocol->name, protocol, frames);
+        check_resync(protocol->name, protocol, frames);
+    }
+
+    check_status();
+
+    printf("%zu frames, %d failed\n", frame_cnt, fail_cnt);
+    return fail_cnt ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+/*
+    Host simulation shim of the FreeRTOS API used by the firmware. Tasks are cooperative coroutines
+    scheduled on virtual time, see sim_rtos.cpp.
+*/
+#ifndef SIM_FREERTOS_H_
+#define SIM_FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+// Provided through the FreeRTOS port of the Pico SDK
+#include "pico/time.h"
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+typedef struct sim_task * TaskHandle_t;
+typedef struct sim_queue * QueueHandle_t;
+typedef struct sim_queue * SemaphoreHandle_t;
+typedef struct sim_queue * QueueSetHandle_t;
+typedef struct sim_queue * QueueSetMemberHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define configMINIMAL_STACK_SIZE    256
+#define configTICK_RATE_HZ          1000
+
+#define portMAX_DELAY               ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS          ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS            portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(x)            ((TickType_t) (((uint64_t) (x) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(x)            ((uint32_t) (((uint64_t) (x) * 1000) / configTICK_RATE_HZ))
+
+#define pdTRUE                      1
+#define pdFALSE                     0
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+
+#define taskSCHEDULER_NOT_STARTED   1
+#define taskSCHEDULER_RUNNING       2
+
+// Tasks only switch at blocking calls, so critical sections and ISR yields need no action
+#define portYIELD_FROM_ISR(x)       (void) (x)
+#define taskENTER_CRITICAL()        do {} while (0)
+#define taskEXIT_CRITICAL()         do {} while (0)
+
+#endif  // SIM_FREERTOS_H_
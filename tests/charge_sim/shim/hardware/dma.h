@@ -0,0 +1,4 @@
+#ifndef SIM_HARDWARE_DMA_H_
+#define SIM_HARDWARE_DMA_H_
+
+#endif  // SIM_HARDWARE_DMA_H_
@@ -0,0 +1,16 @@
+#ifndef SIM_HARDWARE_GPIO_H_
+#define SIM_HARDWARE_GPIO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+#define GPIO_FUNC_UART  2
+
+static inline void gpio_set_function(uint gpio, int fn) {
+    (void) gpio;
+    (void) fn;
+}
+
+#endif  // SIM_HARDWARE_GPIO_H_
@@ -0,0 +1,20 @@
+#ifndef SIM_HARDWARE_IRQ_H_
+#define SIM_HARDWARE_IRQ_H_
+
+#include <stdbool.h>
+
+typedef unsigned int uint;
+typedef void (*irq_handler_t)(void);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_HARDWARE_IRQ_H_
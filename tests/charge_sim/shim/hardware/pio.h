@@ -0,0 +1,10 @@
+#ifndef SIM_HARDWARE_PIO_H_
+#define SIM_HARDWARE_PIO_H_
+
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t * PIO;
+
+#define pio0    ((PIO) 0)
+#define pio1    ((PIO) 1)
+
+#endif  // SIM_HARDWARE_PIO_H_
@@ -0,0 +1,9 @@
+#ifndef SIM_HARDWARE_SPI_H_
+#define SIM_HARDWARE_SPI_H_
+
+typedef struct spi_inst spi_inst_t;
+
+#define spi0    ((spi_inst_t *) 0)
+#define spi1    ((spi_inst_t *) 1)
+
+#endif  // SIM_HARDWARE_SPI_H_
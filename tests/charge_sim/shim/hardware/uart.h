@@ -0,0 +1,45 @@
+#ifndef SIM_HARDWARE_UART_H_
+#define SIM_HARDWARE_UART_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hardware/gpio.h"
+
+typedef unsigned int uint;
+typedef struct uart_inst uart_inst_t;
+
+extern uart_inst_t sim_uart0;
+extern uart_inst_t sim_uart1;
+
+#define uart0   (&sim_uart0)
+#define uart1   (&sim_uart1)
+
+#define UART0_IRQ   20
+#define UART1_IRQ   21
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD,
+} uart_parity_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint uart_init(uart_inst_t * uart, uint baudrate);
+void uart_set_format(uart_inst_t * uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+uint uart_set_baudrate(uart_inst_t * uart, uint baudrate);
+void uart_set_irq_enables(uart_inst_t * uart, bool rx_has_data, bool tx_needs_data);
+bool uart_is_readable(uart_inst_t * uart);
+char uart_getc(uart_inst_t * uart);
+void uart_puts(uart_inst_t * uart, const char * s);
+void uart_write_blocking(uart_inst_t * uart, const uint8_t * src, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_HARDWARE_UART_H_
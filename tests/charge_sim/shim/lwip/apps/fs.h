@@ -0,0 +1,14 @@
+#ifndef SIM_LWIP_FS_H_
+#define SIM_LWIP_FS_H_
+
+struct fs_file {
+    const char * data;
+    int len;
+    int index;
+    unsigned char flags;
+};
+
+#define FS_FILE_FLAGS_HEADER_INCLUDED       0x01
+#define FS_FILE_FLAGS_HEADER_PERSISTENT     0x02
+
+#endif  // SIM_LWIP_FS_H_
@@ -0,0 +1,4 @@
+#ifndef SIM_LWIP_HTTPD_H_
+#define SIM_LWIP_HTTPD_H_
+
+#endif  // SIM_LWIP_HTTPD_H_
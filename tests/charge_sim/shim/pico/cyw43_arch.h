@@ -0,0 +1,6 @@
+#ifndef SIM_PICO_CYW43_ARCH_H_
+#define SIM_PICO_CYW43_ARCH_H_
+
+#define CYW43_WL_GPIO_LED_PIN   0
+
+#endif  // SIM_PICO_CYW43_ARCH_H_
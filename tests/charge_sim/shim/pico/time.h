@@ -0,0 +1,32 @@
+#ifndef SIM_PICO_TIME_H_
+#define SIM_PICO_TIME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t * rt);
+
+struct repeating_timer {
+    int64_t delay_us;
+    void * user_data;
+    int32_t alarm_id;
+    repeating_timer_callback_t callback;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Virtual time of the simulation
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void busy_wait_us(uint64_t delay_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_PICO_TIME_H_
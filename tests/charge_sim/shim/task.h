@@ -0,0 +1,29 @@
+#ifndef SIM_TASK_H_
+#define SIM_TASK_H_
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BaseType_t xTaskCreate(TaskFunction_t task_function, const char * name, uint32_t stack_depth, void * parameters, UBaseType_t priority, TaskHandle_t * created_task);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks_to_delay);
+void vTaskDelayUntil(TickType_t * previous_wake_time, TickType_t time_increment);
+TickType_t xTaskGetTickCount(void);
+BaseType_t xTaskGetSchedulerState(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * higher_priority_task_woken);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_TASK_H_
@@ -0,0 +1,32 @@
+#ifndef SIM_U8G2_H_
+#define SIM_U8G2_H_
+
+#include <stdint.h>
+
+// The render tasks draw into a discarded frame
+typedef struct {
+    int unused;
+} u8g2_t;
+
+extern const uint8_t u8g2_font_helvB08_tr[];
+extern const uint8_t u8g2_font_helvR08_tr[];
+extern const uint8_t u8g2_font_profont11_tf[];
+extern const uint8_t u8g2_font_profont22_tf[];
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void u8g2_ClearBuffer(u8g2_t * u8g2);
+void u8g2_SendBuffer(u8g2_t * u8g2);
+void u8g2_SetFont(u8g2_t * u8g2, const uint8_t * font);
+uint16_t u8g2_DrawStr(u8g2_t * u8g2, uint16_t x, uint16_t y, const char * str);
+void u8g2_DrawHLine(u8g2_t * u8g2, uint16_t x, uint16_t y, uint16_t w);
+uint16_t u8g2_GetDisplayWidth(u8g2_t * u8g2);
+uint16_t u8g2_GetStrWidth(u8g2_t * u8g2, const char * str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_U8G2_H_
@@ -0,0 +1,37 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "hardware/uart.h"
+#include "motors.h"
+
+
+// Called once every virtual millisecond while no task is runnable
+typedef void (*sim_world_tick_t)(uint64_t now_us);
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Scheduler (sim_rtos.cpp)
+void sim_set_world_tick(sim_world_tick_t tick);
+bool sim_run(uint64_t time_limit_us);
+void sim_stop(void);
+
+// Peripherals (sim_hal.cpp)
+void sim_uart_receive(uart_inst_t * uart, const char * data, size_t len);
+size_t sim_uart_take_transmitted(uart_inst_t * uart, char * buf, size_t len);
+float sim_motor_get_speed(motor_select_t selected_motor);
+bool sim_motor_is_enabled(motor_select_t selected_motor);
+void sim_motor_step(float dt_s);
+void sim_eeprom_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_H_
@@ -0,0 +1,335 @@
+/*
+    Peripherals of the controller board, replaced at the API level of the firmware modules that are
+    not part of the simulation (motors, servo gate, LEDs, display and EEPROM) and at the SDK level
+    for the scale UART.
+*/
+#include <deque>
+#include <string>
+#include <math.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "u8g2.h"
+
+#include "app.h"
+#include "display.h"
+#include "eeprom.h"
+#include "motors.h"
+#include "neopixel_led.h"
+#include "scale.h"
+#include "servo_gate.h"
+
+#include "sim.h"
+
+
+#define SIM_EEPROM_SIZE     (32 * 1024)
+#define SIM_IRQ_CNT         32
+
+
+// UART
+struct uart_inst {
+    int irq_num;
+    bool rx_irq_enabled;
+    std::deque<char> rx_fifo;
+    std::string tx_data;
+};
+
+uart_inst_t sim_uart0 = {UART0_IRQ, false, {}, {}};
+uart_inst_t sim_uart1 = {UART1_IRQ, false, {}, {}};
+
+static irq_handler_t irq_handlers[SIM_IRQ_CNT];
+static bool irq_enabled[SIM_IRQ_CNT];
+
+
+uint uart_init(uart_inst_t * uart, uint baudrate) {
+    uart->rx_fifo.clear();
+    uart->tx_data.clear();
+
+    return baudrate;
+}
+
+
+void uart_set_format(uart_inst_t * uart, uint data_bits, uint stop_bits, uart_parity_t parity) {
+    (void) uart;
+    (void) data_bits;
+    (void) stop_bits;
+    (void) parity;
+}
+
+
+uint uart_set_baudrate(uart_inst_t * uart, uint baudrate) {
+    (void) uart;
+    return baudrate;
+}
+
+
+void uart_set_irq_enables(uart_inst_t * uart, bool rx_has_data, bool tx_needs_data) {
+    (void) tx_needs_data;
+    uart->rx_irq_enabled = rx_has_data;
+}
+
+
+bool uart_is_readable(uart_inst_t * uart) {
+    return !uart->rx_fifo.empty();
+}
+
+
+char uart_getc(uart_inst_t * uart) {
+    char ch = uart->rx_fifo.front();
+    uart->rx_fifo.pop_front();
+
+    return ch;
+}
+
+
+void uart_puts(uart_inst_t * uart, const char * s) {
+    uart->tx_data.append(s);
+}
+
+
+void uart_write_blocking(uart_inst_t * uart, const uint8_t * src, size_t len) {
+    uart->tx_data.append((const char *) src, len);
+}
+
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    irq_handlers[num] = handler;
+}
+
+
+void irq_set_enabled(uint num, bool enabled) {
+    irq_enabled[num] = enabled;
+}
+
+
+void sim_uart_receive(uart_inst_t * uart, const char * data, size_t len) {
+    uart->rx_fifo.insert(uart->rx_fifo.end(), data, data + len);
+
+    if (uart->rx_irq_enabled && irq_enabled[uart->irq_num] && irq_handlers[uart->irq_num]) {
+        irq_handlers[uart->irq_num]();
+    }
+}
+
+
+size_t sim_uart_take_transmitted(uart_inst_t * uart, char * buf, size_t len) {
+    size_t copied = uart->tx_data.copy(buf, len);
+    uart->tx_data.erase(0, copied);
+
+    return copied;
+}
+
+
+// Motors, following the default motor configuration
+typedef struct {
+    float max_speed_rps;
+    float min_speed_rps;
+    float angular_acceleration;
+
+    bool enabled;
+    float target_speed_rps;
+    float speed_rps;
+
+    float move_revolutions_left;        // Counted move in progress if above 0
+} sim_motor_t;
+
+static sim_motor_t sim_motors[2] = {
+    {5, 0.08f, 50, false, 0, 0, 0},
+    {5, 0.01f, 50, false, 0, 0, 0},
+};
+
+
+void motor_set_speed(motor_select_t selected_motor, float new_velocity) {
+    if (selected_motor == SELECT_BOTH_MOTOR) {
+        motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, new_velocity);
+        motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, new_velocity);
+        return;
+    }
+
+    sim_motors[selected_motor].target_speed_rps = new_velocity;
+    sim_motors[selected_motor].move_revolutions_left = 0;
+}
+
+
+bool motor_move_revolutions(motor_select_t selected_motor, float revolutions, float speed) {
+    if (selected_motor == SELECT_BOTH_MOTOR || revolutions <= 0) {
+        return false;
+    }
+
+    // The counted move starts at the speed without a ramp
+    sim_motor_t * motor = &sim_motors[selected_motor];
+    motor->target_speed_rps = speed;
+    motor->speed_rps = speed;
+    motor->move_revolutions_left = revolutions;
+
+    return true;
+}
+
+
+bool motor_is_moving_revolutions(motor_select_t selected_motor) {
+    return sim_motors[selected_motor].move_revolutions_left > 0;
+}
+
+
+uint16_t get_motor_max_speed(motor_select_t selected_motor) {
+    return sim_motors[selected_motor].max_speed_rps;
+}
+
+
+float get_motor_min_speed(motor_select_t selected_motor) {
+    return sim_motors[selected_motor].min_speed_rps;
+}
+
+
+void motor_enable(motor_select_t selected_motor, bool enable) {
+    if (selected_motor == SELECT_BOTH_MOTOR) {
+        motor_enable(SELECT_COARSE_TRICKLER_MOTOR, enable);
+        motor_enable(SELECT_FINE_TRICKLER_MOTOR, enable);
+        return;
+    }
+
+    sim_motors[selected_motor].enabled = enable;
+}
+
+
+float sim_motor_get_speed(motor_select_t selected_motor) {
+    sim_motor_t * motor = &sim_motors[selected_motor];
+    return motor->enabled ? motor->speed_rps : 0.0f;
+}
+
+
+bool sim_motor_is_enabled(motor_select_t selected_motor) {
+    return sim_motors[selected_motor].enabled;
+}
+
+
+void sim_motor_step(float dt_s) {
+    for (sim_motor_t & motor : sim_motors) {
+        if (motor.move_revolutions_left > 0) {
+            motor.move_revolutions_left -= fabsf(motor.speed_rps) * dt_s;
+            if (motor.move_revolutions_left <= 0) {
+                motor.move_revolutions_left = 0;
+                motor.target_speed_rps = 0;
+                motor.speed_rps = 0;
+            }
+            continue;
+        }
+
+        // The stepper accelerates at a constant rate towards the new speed
+        float max_dv = motor.angular_acceleration * dt_s;
+        float dv = motor.target_speed_rps - motor.speed_rps;
+
+        motor.speed_rps += fmaxf(-max_dv, fminf(dv, max_dv));
+    }
+}
+
+
+// Servo gate, not fitted
+servo_gate_t servo_gate;
+
+void servo_gate_set_ratio(float ratio, bool block_wait) {
+    (void) block_wait;
+    servo_gate.gate_ratio = ratio;
+}
+
+bool servo_gate_is_move_complete(void) {
+    return true;
+}
+
+
+// LEDs
+neopixel_led_config_t neopixel_led_config;
+
+void neopixel_led_set_colour(rgbw_u32_t mini12864_backlight_colour, rgbw_u32_t led1_colour, rgbw_u32_t led2_colour, bool block_wait) {
+    (void) mini12864_backlight_colour;
+    (void) led1_colour;
+    (void) led2_colour;
+    (void) block_wait;
+}
+
+
+uint32_t hex_string_to_decimal(char * string) {
+    return strtoul(string, NULL, 16);
+}
+
+
+// Display
+static u8g2_t sim_display;
+
+const uint8_t u8g2_font_helvB08_tr[1] = {0};
+const uint8_t u8g2_font_helvR08_tr[1] = {0};
+const uint8_t u8g2_font_profont11_tf[1] = {0};
+const uint8_t u8g2_font_profont22_tf[1] = {0};
+
+u8g2_t * get_display_handler(void) {
+    return &sim_display;
+}
+
+void u8g2_ClearBuffer(u8g2_t * u8g2) { (void) u8g2; }
+void u8g2_SendBuffer(u8g2_t * u8g2) { (void) u8g2; }
+void u8g2_SetFont(u8g2_t * u8g2, const uint8_t * font) { (void) u8g2; (void) font; }
+uint16_t u8g2_DrawStr(u8g2_t * u8g2, uint16_t x, uint16_t y, const char * str) { (void) u8g2; (void) x; (void) y; return strlen(str) * 6; }
+void u8g2_DrawHLine(u8g2_t * u8g2, uint16_t x, uint16_t y, uint16_t w) { (void) u8g2; (void) x; (void) y; (void) w; }
+uint16_t u8g2_GetDisplayWidth(u8g2_t * u8g2) { (void) u8g2; return 128; }
+uint16_t u8g2_GetStrWidth(u8g2_t * u8g2, const char * str) { (void) u8g2; return strlen(str) * 6; }
+
+
+// EEPROM, kept in memory for the duration of the run
+static uint8_t sim_eeprom[SIM_EEPROM_SIZE];
+
+void sim_eeprom_erase(void) {
+    memset(sim_eeprom, 0xff, sizeof(sim_eeprom));
+}
+
+
+bool eeprom_read(uint16_t data_addr, uint8_t * data, size_t len) {
+    if (data_addr + len > SIM_EEPROM_SIZE) {
+        return false;
+    }
+
+    memcpy(data, sim_eeprom + data_addr, len);
+    return true;
+}
+
+
+bool eeprom_write(uint16_t data_addr, uint8_t * data, size_t len) {
+    if (data_addr + len > SIM_EEPROM_SIZE) {
+        return false;
+    }
+
+    memcpy(sim_eeprom + data_addr, data, len);
+    return true;
+}
+
+
+void eeprom_register_handler(eeprom_save_handler_t handler) {
+    (void) handler;
+}
+
+
+// TMC2209 datagram CRC from the motor driver library, also used by the profile checksum
+extern "C" void swuart_calcCRC(uint8_t * datagram, uint8_t datagram_length) {
+    uint8_t * crc = datagram + (datagram_length - 1);
+    *crc = 0;
+
+    for (int idx = 0; idx < datagram_length - 1; idx += 1) {
+        uint8_t current_byte = datagram[idx];
+
+        for (int bit = 0; bit < 8; bit += 1) {
+            if ((*crc >> 7) ^ (current_byte & 0x01)) {
+                *crc = (*crc << 1) ^ 0x07;
+            }
+            else {
+                *crc = (*crc << 1);
+            }
+            current_byte >>= 1;
+        }
+    }
+}
+
+
+// Menu system
+AppState_t exit_state = APP_STATE_DEFAULT;
+QueueHandle_t encoder_event_queue = NULL;
+
@@ -0,0 +1,495 @@
+/*
+    Cooperative implementation of the FreeRTOS API on virtual time.
+
+    Every task runs as a coroutine and only gives up the CPU at a blocking call. The highest priority
+    runnable task is resumed first, tasks of the same priority are resumed in a round robin fashion.
+    When no task is runnable the virtual clock advances to the next wake up time or the next
+    millisecond, whichever comes first, and the world (see sim_set_world_tick) is stepped once every
+    millisecond. Code under test therefore sees a deterministic clock that does not depend on the
+    host speed.
+*/
+#include <ucontext.h>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "pico/time.h"
+
+#include "sim.h"
+
+
+#define SIM_TASK_STACK_SIZE     (256 * 1024)
+#define SIM_NO_DEADLINE         UINT64_MAX
+
+
+struct sim_task {
+    ucontext_t context;
+    std::vector<char> stack;
+
+    TaskFunction_t task_function;
+    void * parameters;
+    const char * name;
+    UBaseType_t priority;
+
+    // Blocking state
+    std::function<bool(void)> unblock_condition;
+    uint64_t deadline_us;
+    bool suspended;
+    bool finished;
+
+    uint32_t notification_count;
+    uint64_t last_run_order;
+};
+
+
+struct sim_queue {
+    size_t length;
+    size_t item_size;
+    std::deque<std::vector<uint8_t>> items;
+
+    sim_queue * set;            // Queue set this queue is a member of, NULL if none
+};
+
+
+static ucontext_t scheduler_context;
+static std::vector<sim_task *> tasks;
+static sim_task * current_task = NULL;
+
+static uint64_t virtual_time_us = 0;
+static uint64_t run_order = 0;
+static bool stop_requested = false;
+
+static sim_world_tick_t world_tick = NULL;
+static uint64_t next_world_tick_us = 0;
+
+
+static void task_entry(void) {
+    current_task->task_function(current_task->parameters);
+
+    // Returning from a task is not allowed in FreeRTOS, treat it as a self delete
+    current_task->finished = true;
+    swapcontext(&current_task->context, &scheduler_context);
+}
+
+
+/*
+    Block the current task until the condition is met or the timeout expires. Returns true if
+    the condition is met.
+*/
+static bool block_until(std::function<bool(void)> condition, TickType_t ticks_to_wait) {
+    if (condition()) {
+        return true;
+    }
+
+    if (ticks_to_wait == 0 || current_task == NULL) {
+        return false;
+    }
+
+    sim_task * task = current_task;
+    task->unblock_condition = condition;
+    task->deadline_us = ticks_to_wait == portMAX_DELAY ? SIM_NO_DEADLINE : virtual_time_us + (uint64_t) ticks_to_wait * 1000;
+
+    swapcontext(&task->context, &scheduler_context);
+
+    task->unblock_condition = nullptr;
+    return condition();
+}
+
+
+static bool is_runnable(sim_task * task) {
+    if (task->finished || task->suspended) {
+        return false;
+    }
+
+    if (!task->unblock_condition) {
+        return true;
+    }
+
+    return virtual_time_us >= task->deadline_us || task->unblock_condition();
+}
+
+
+static sim_task * select_next_task() {
+    sim_task * selected = NULL;
+
+    for (sim_task * task : tasks) {
+        if (!is_runnable(task)) {
+            continue;
+        }
+
+        // Higher priority first, then the one waited the longest
+        if (selected == NULL ||
+            task->priority > selected->priority ||
+            (task->priority == selected->priority && task->last_run_order < selected->last_run_order)) {
+            selected = task;
+        }
+    }
+
+    return selected;
+}
+
+
+static uint64_t next_deadline_us() {
+    uint64_t deadline_us = SIM_NO_DEADLINE;
+
+    for (sim_task * task : tasks) {
+        if (!task->finished && !task->suspended && task->unblock_condition) {
+            deadline_us = std::min(deadline_us, task->deadline_us);
+        }
+    }
+
+    return deadline_us;
+}
+
+
+void sim_set_world_tick(sim_world_tick_t tick) {
+    world_tick = tick;
+}
+
+
+void sim_stop(void) {
+    stop_requested = true;
+}
+
+
+bool sim_run(uint64_t time_limit_us) {
+    stop_requested = false;
+
+    while (!stop_requested) {
+        sim_task * task = select_next_task();
+
+        if (task) {
+            task->last_run_order = ++run_order;
+            current_task = task;
+            swapcontext(&scheduler_context, &task->context);
+            current_task = NULL;
+            continue;
+        }
+
+        // Nothing to run, advance the virtual clock
+        uint64_t next_time_us = std::min(next_deadline_us(), next_world_tick_us);
+        if (next_time_us == SIM_NO_DEADLINE) {
+            printf("Simulation deadlocked at %llu us\n", (unsigned long long) virtual_time_us);
+            return false;
+        }
+        if (next_time_us > time_limit_us) {
+            printf("Simulation time limit reached\n");
+            return false;
+        }
+
+        virtual_time_us = std::max(virtual_time_us, next_time_us);
+
+        if (virtual_time_us >= next_world_tick_us) {
+            if (world_tick) {
+                world_tick(virtual_time_us);
+            }
+            next_world_tick_us += 1000;
+        }
+    }
+
+    return true;
+}
+
+
+// Time
+uint32_t time_us_32(void) {
+    return (uint32_t) virtual_time_us;
+}
+
+
+uint64_t time_us_64(void) {
+    return virtual_time_us;
+}
+
+
+void busy_wait_us(uint64_t delay_us) {
+    // Busy waiting does not let other tasks run
+    virtual_time_us += delay_us;
+}
+
+
+// Tasks
+BaseType_t xTaskCreate(TaskFunction_t task_function, const char * name, uint32_t stack_depth, void * parameters, UBaseType_t priority, TaskHandle_t * created_task) {
+    (void) stack_depth;
+
+    sim_task * task = new sim_task();
+    task->task_function = task_function;
+    task->parameters = parameters;
+    task->name = name;
+    task->priority = priority;
+    task->deadline_us = SIM_NO_DEADLINE;
+    task->suspended = false;
+    task->finished = false;
+    task->notification_count = 0;
+    task->last_run_order = 0;
+    task->stack.resize(SIM_TASK_STACK_SIZE);
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack.data();
+    task->context.uc_stack.ss_size = task->stack.size();
+    task->context.uc_link = &scheduler_context;
+    makecontext(&task->context, task_entry, 0);
+
+    tasks.push_back(task);
+
+    if (created_task) {
+        *created_task = task;
+    }
+
+    return pdPASS;
+}
+
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL) {
+        task = current_task;
+    }
+
+    task->finished = true;
+
+    if (task == current_task) {
+        swapcontext(&task->context, &scheduler_context);
+    }
+}
+
+
+void vTaskDelay(TickType_t ticks_to_delay) {
+    uint64_t wake_time_us = virtual_time_us + (uint64_t) ticks_to_delay * 1000;
+    block_until([wake_time_us]() { return virtual_time_us >= wake_time_us; }, portMAX_DELAY);
+}
+
+
+void vTaskDelayUntil(TickType_t * previous_wake_time, TickType_t time_increment) {
+    TickType_t wake_tick = *previous_wake_time + time_increment;
+    *previous_wake_time = wake_tick;
+
+    // Already late, return immediately as FreeRTOS does
+    if ((int32_t) (wake_tick - xTaskGetTickCount()) <= 0) {
+        return;
+    }
+
+    vTaskDelay(wake_tick - xTaskGetTickCount());
+}
+
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t) (virtual_time_us / 1000);
+}
+
+
+BaseType_t xTaskGetSchedulerState(void) {
+    return taskSCHEDULER_RUNNING;
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return current_task;
+}
+
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    if (task == NULL) {
+        task = current_task;
+    }
+
+    return task->priority;
+}
+
+
+void vTaskSuspend(TaskHandle_t task) {
+    if (task == NULL) {
+        task = current_task;
+    }
+
+    task->suspended = true;
+
+    if (task == current_task) {
+        swapcontext(&task->context, &scheduler_context);
+    }
+}
+
+
+void vTaskResume(TaskHandle_t task) {
+    task->suspended = false;
+}
+
+
+// Notifications
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait) {
+    sim_task * task = current_task;
+
+    block_until([task]() { return task->notification_count > 0; }, ticks_to_wait);
+
+    uint32_t count = task->notification_count;
+    if (count > 0) {
+        task->notification_count = clear_count_on_exit ? 0 : count - 1;
+    }
+
+    return count;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->notification_count += 1;
+    return pdPASS;
+}
+
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * higher_priority_task_woken) {
+    task->notification_count += 1;
+
+    if (higher_priority_task_woken) {
+        *higher_priority_task_woken = pdTRUE;
+    }
+}
+
+
+// Queues
+QueueHandle_t xQueueCreate(UBaseType_t queue_length, UBaseType_t item_size) {
+    sim_queue * queue = new sim_queue();
+    queue->length = queue_length;
+    queue->item_size = item_size;
+
+    return queue;
+}
+
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t ticks_to_wait) {
+    if (!block_until([queue]() { return queue->items.size() < queue->length; }, ticks_to_wait)) {
+        return pdFAIL;
+    }
+
+    const uint8_t * bytes = (const uint8_t *) item;
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+
+    // Same as FreeRTOS, the set must have room for every item posted to its members
+    if (queue->set) {
+        assert(queue->set->items.size() < queue->set->length);
+
+        const uint8_t * handle_bytes = (const uint8_t *) &queue;
+        queue->set->items.emplace_back(handle_bytes, handle_bytes + sizeof(queue));
+    }
+
+    return pdPASS;
+}
+
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void * item, BaseType_t * higher_priority_task_woken) {
+    if (higher_priority_task_woken) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+
+    return xQueueSend(queue, item, 0);
+}
+
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void * item) {
+    assert(queue->set == NULL);
+    queue->items.clear();
+    return xQueueSend(queue, item, 0);
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void * buffer, TickType_t ticks_to_wait) {
+    if (!block_until([queue]() { return !queue->items.empty(); }, ticks_to_wait)) {
+        return pdFAIL;
+    }
+
+    if (queue->item_size > 0) {
+        memcpy(buffer, queue->items.front().data(), queue->item_size);
+    }
+    queue->items.pop_front();
+
+    return pdPASS;
+}
+
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void * buffer, TickType_t ticks_to_wait) {
+    if (!block_until([queue]() { return !queue->items.empty(); }, ticks_to_wait)) {
+        return pdFAIL;
+    }
+
+    memcpy(buffer, queue->items.front().data(), queue->item_size);
+
+    return pdPASS;
+}
+
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    queue->items.clear();
+    return pdPASS;
+}
+
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->items.size();
+}
+
+
+// Queue sets are queues of member handles, posted along every item sent to a member
+QueueSetHandle_t xQueueCreateSet(UBaseType_t event_queue_length) {
+    return xQueueCreate(event_queue_length, sizeof(QueueSetMemberHandle_t));
+}
+
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set) {
+    if (member->set != NULL || !member->items.empty()) {
+        return pdFAIL;
+    }
+
+    member->set = set;
+    return pdPASS;
+}
+
+
+BaseType_t xQueueRemoveFromSet(QueueSetMemberHandle_t member, QueueSetHandle_t set) {
+    if (member->set != set || !member->items.empty()) {
+        return pdFAIL;
+    }
+
+    member->set = NULL;
+    return pdPASS;
+}
+
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t ticks_to_wait) {
+    QueueSetMemberHandle_t member = NULL;
+    if (xQueueReceive(set, &member, ticks_to_wait) != pdPASS) {
+        return NULL;
+    }
+
+    return member;
+}
+
+
+// Semaphores are queues of zero sized items
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+    xQueueSend(mutex, NULL, 0);
+
+    return mutex;
+}
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+    return xQueueReceive(semaphore, NULL, ticks_to_wait);
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return xQueueSend(semaphore, NULL, 0);
+}
@@ -0,0 +1,35 @@
+#ifndef TEST_CHECK_H_
+#define TEST_CHECK_H_
+
+/*
+    Check harness of the host tests. CHECK() reports a failed condition with its line and carries on,
+    so one run lists every failure. check_report() prints the summary and returns the exit code.
+*/
+#include <stdio.h>
+#include <stdbool.h>
+
+
+static int fail_cnt = 0;
+
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static inline void check(bool cond, const char * expr, int line) {
+    if (!cond) {
+        printf("FAIL line %d: %s\n", line, expr);
+        fail_cnt++;
+    }
+}
+
+
+static inline int check_report(void) {
+    if (fail_cnt) {
+        printf("%d check(s) failed\n", fail_cnt);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
+
+#endif  // TEST_CHECK_H_
@@ -0,0 +1,158 @@
+/*
+    Compares the float speed_to_period() with the integer speed_mrps_to_period() on the host. Reports
+    the time per conversion of each and checks that both agree within one PIO cycle over the speed
+    range of the tricklers.
+
+    The host has an FPU, the RP2040 does not. On the controller the float path runs in soft-float and
+    the gap is wider than measured here.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_CYCLE_COUNTER   1
+#endif
+
+#include "motor_period.h"
+
+
+#define SPEED_MRPS_MAX      10000   // 10 rev/s, above the default maximum speed of both motors
+#define BENCH_ROUNDS        200
+
+
+typedef struct {
+    const char * name;
+    uint32_t pio_clock_speed;
+    uint32_t full_rotation_steps;
+} bench_config_t;
+
+
+static const bench_config_t bench_configs[] = {
+    {"125MHz 200x256", 125000000, 200 * 256},
+    {"125MHz 400x256", 125000000, 400 * 256},
+    {"133MHz 200x16", 133000000, 200 * 16},
+    {"200MHz 200x256", 200000000, 200 * 256},
+};
+
+
+static float speed_rps[SPEED_MRPS_MAX + 1];
+static uint32_t speed_mrps[SPEED_MRPS_MAX + 1];
+static volatile uint32_t sink;
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static uint64_t now_cycles(void) {
+#ifdef HAS_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+// Returns the number of conversions where the float and the integer path differ by more than one cycle
+static uint32_t check_config(const bench_config_t * config, const motor_period_scale_t * scale) {
+    uint32_t mismatch_cnt = 0;
+
+    for (uint32_t idx = 0; idx <= SPEED_MRPS_MAX; idx += 1) {
+        uint32_t float_period = speed_to_period(speed_rps[idx], config->pio_clock_speed, config->full_rotation_steps);
+        uint32_t int_period = speed_mrps_to_period(scale, speed_mrps[idx]);
+
+        // Either path may cut off at the maximum response time first
+        uint32_t cutoff_period = scale->max_full_cycle_count - STEPPER_LOW_CYCLE_COUNT;
+        bool at_cutoff = (float_period == 0 && int_period + 1 >= cutoff_period) ||
+                         (int_period == 0 && float_period + 1 >= cutoff_period);
+
+        uint32_t diff = float_period > int_period ? float_period - int_period : int_period - float_period;
+        if (diff > 1 && !at_cutoff) {
+            if (mismatch_cnt == 0) {
+                printf("  %u mrps: float %u, integer %u\n", speed_mrps[idx], float_period, int_period);
+            }
+            mismatch_cnt += 1;
+        }
+    }
+
+    return mismatch_cnt;
+}
+
+
+static void bench_config(const bench_config_t * config, const motor_period_scale_t * scale) {
+    uint64_t conversion_cnt = (uint64_t) BENCH_ROUNDS * (SPEED_MRPS_MAX + 1);
+    uint32_t acc = 0;
+
+    uint64_t start_ns = now_ns();
+    uint64_t start_cycles = now_cycles();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round += 1) {
+        for (uint32_t idx = 0; idx <= SPEED_MRPS_MAX; idx += 1) {
+            acc += speed_to_period(speed_rps[idx], config->pio_clock_speed, config->full_rotation_steps);
+        }
+    }
+    double float_cycles = (double) (now_cycles() - start_cycles) / conversion_cnt;
+    double float_ns = (double) (now_ns() - start_ns) / conversion_cnt;
+
+    start_ns = now_ns();
+    start_cycles = now_cycles();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round += 1) {
+        for (uint32_t idx = 0; idx <= SPEED_MRPS_MAX; idx += 1) {
+            acc += speed_mrps_to_period(scale, speed_mrps[idx]);
+        }
+    }
+    double int_cycles = (double) (now_cycles() - start_cycles) / conversion_cnt;
+    double int_ns = (double) (now_ns() - start_ns) / conversion_cnt;
+
+    sink = acc;
+
+#ifdef HAS_CYCLE_COUNTER
+    printf("%-16s float %6.2f ns %6.1f cycles, integer %6.2f ns %6.1f cycles, speedup %.2fx\n",
+           config->name, float_ns, float_cycles, int_ns, int_cycles, float_ns / int_ns);
+#else
+    (void) float_cycles;
+    (void) int_cycles;
+    printf("%-16s float %6.2f ns, integer %6.2f ns, speedup %.2fx\n",
+           config->name, float_ns, int_ns, float_ns / int_ns);
+#endif
+}
+
+
+int main(int argc, char * argv[]) {
+    bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+
+    for (uint32_t idx = 0; idx <= SPEED_MRPS_MAX; idx += 1) {
+        speed_mrps[idx] = idx;
+        speed_rps[idx] = idx / 1000.0f;
+    }
+
+    uint32_t total_mismatch_cnt = 0;
+
+    for (size_t idx = 0; idx < sizeof(bench_configs) / sizeof(bench_configs[0]); idx += 1) {
+        const bench_config_t * config = &bench_configs[idx];
+
+        motor_period_scale_t scale;
+        memset(&scale, 0, sizeof(scale));
+        motor_period_scale_update(&scale, config->pio_clock_speed, config->full_rotation_steps);
+
+        uint32_t mismatch_cnt = check_config(config, &scale);
+        if (mismatch_cnt) {
+            printf("%-16s %u of %u conversions differ by more than one cycle\n", config->name, mismatch_cnt, SPEED_MRPS_MAX + 1);
+        }
+        total_mismatch_cnt += mismatch_cnt;
+
+        if (!check_only) {
+            bench_config(config, &scale);
+        }
+    }
+
+    return total_mismatch_cnt ? 1 : 0;
+}
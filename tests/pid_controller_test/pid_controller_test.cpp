@@ -0,0 +1,233 @@
+/*
+    Checks the PIDController used by the charge mode on the host: the integral and derivative follow
+    the time step rather than the sample count, the integral does not wind up against the output
+    limits, the derivative ignores setpoint steps, and back to back samples with dt = 0 and non-finite
+    inputs are harmless.
+
+    Exits non-zero if any check fails.
+*/
+#include <stdio.h>
+#include <math.h>
+
+#include "PIDController.h"
+#include "test_check.h"
+
+
+static bool near(float a, float b, float tolerance) {
+    return fabsf(a - b) <= tolerance;
+}
+
+
+// The integral over a fixed time is the same at any sample rate
+static void test_integral_follows_time() {
+    const float rates_hz[] = {5.0f, 10.0f, 100.0f};
+
+    for (float rate_hz : rates_hz) {
+        PIDController pid;
+        pid.setGains(0.0f, 1.0f, 0.0f);
+
+        float dt_s = 1.0f / rate_hz;
+        int sample_cnt = (int) roundf(2.0f * rate_hz);
+        for (int idx = 0; idx < sample_cnt; idx++) {
+            pid.update(1.0f, 0.0f, dt_s);
+        }
+
+        CHECK(near(pid.getIntegral(), 2.0f, 1e-3f));
+        CHECK(near(pid.getOutput(), 2.0f, 1e-3f));
+    }
+}
+
+
+// A long saturation leaves the integral where it was, the output comes off the limit as soon as the error reverses
+static void test_anti_windup() {
+    PIDController pid;
+    pid.setGains(0.1f, 0.5f, 0.0f);
+    pid.setOutputLimits(0.0f, 1.0f);
+
+    for (int idx = 0; idx < 300; idx++) {
+        pid.update(30.0f, 0.0f, 0.1f);
+    }
+    CHECK(pid.isSaturated());
+    CHECK(pid.getOutput() == 1.0f);
+    CHECK(pid.getIntegral() < 1.0f / 0.5f);
+
+    // Small overshoot, a wound up integral (0.5 * 30 * 30 s) would hold the output at the limit here
+    float output = pid.update(30.0f, 30.5f, 0.1f);
+    CHECK(output < 1.0f);
+
+    // The lower limit holds the integral the same way
+    pid.reset();
+    for (int idx = 0; idx < 300; idx++) {
+        pid.update(0.0f, 30.0f, 0.1f);
+    }
+    CHECK(pid.getOutput() == 0.0f);
+    CHECK(pid.getIntegral() > -1.0f / 0.5f);
+}
+
+
+// The feed forward counts towards the saturation
+static void test_feed_forward_saturation() {
+    PIDController pid;
+    pid.setGains(0.0f, 1.0f, 0.0f);
+    pid.setOutputLimits(0.0f, 1.0f);
+
+    for (int idx = 0; idx < 100; idx++) {
+        pid.update(1.0f, 0.0f, 0.1f, 1.0f);
+    }
+    CHECK(pid.getOutput() == 1.0f);
+    CHECK(pid.getIntegral() == 0.0f);
+}
+
+
+// Samples with the same timestamp leave the integral and the derivative unchanged
+static void test_zero_dt() {
+    PIDController pid;
+    pid.setGains(1.0f, 1.0f, 1.0f);
+
+    pid.update(10.0f, 0.0f, 0.1f);
+    pid.update(10.0f, 1.0f, 0.1f);
+    float integral = pid.getIntegral();
+    float derivative = pid.getDerivative();
+
+    for (int idx = 0; idx < 5; idx++) {
+        float output = pid.update(10.0f, 2.0f, 0.0f);
+        CHECK(isfinite(output));
+    }
+    CHECK(pid.getIntegral() == integral);
+    CHECK(pid.getDerivative() == derivative);
+
+    // Negative time steps (out of order timestamps) are treated the same
+    pid.update(10.0f, 2.0f, -0.1f);
+    CHECK(pid.getIntegral() == integral);
+
+    // The first sample after reset has no history either
+    pid.reset();
+    CHECK(isfinite(pid.update(10.0f, 5.0f, 0.0f)));
+    CHECK(pid.getDerivative() == 0.0f);
+}
+
+
+// A non-finite input holds the previous output, the following samples are controlled as if it never came
+static void test_non_finite_input() {
+    PIDController pid;
+    pid.setGains(10.0f, 0.5f, 0.0f);
+    pid.setOutputLimits(0.0f, 2.0f);
+    pid.setDerivativeFilter(0.05f);
+
+    pid.update(1.0f, 0.98f, 0.1f);
+    float output = pid.update(1.0f, 0.99f, 0.1f);
+    float integral = pid.getIntegral();
+    float derivative = pid.getDerivative();
+
+    const float inputs[][3] = {
+        {1.0f, NAN, 0.1f},
+        {1.0f, INFINITY, 0.1f},
+        {NAN, 0.99f, 0.1f},
+        {1.0f, 0.99f, NAN},
+        {1.0f, 0.99f, INFINITY},
+    };
+    for (const auto & input : inputs) {
+        CHECK(pid.update(input[0], input[1], input[2]) == output);
+        CHECK(pid.update(1.0f, 0.99f, 0.1f, NAN) == output);
+        CHECK(pid.getIntegral() == integral);
+        CHECK(pid.getDerivative() == derivative);
+    }
+
+    // Error 0.01: 0.1 from kp with the small integral, not latched at the upper limit
+    output = pid.update(1.0f, 0.99f, 0.1f);
+    CHECK(near(output, 0.1f + 0.5f * pid.getIntegral(), 1e-5f));
+    CHECK(output < 0.2f);
+    CHECK(isfinite(pid.getDerivative()));
+}
+
+
+// The derivative is taken on the measurement: a setpoint step does not kick the output, a ramp does act
+static void test_derivative_on_measurement() {
+    PIDController pid;
+    pid.setGains(0.0f, 0.0f, 2.0f);
+
+    pid.update(0.0f, 5.0f, 0.1f);
+    float output = pid.update(100.0f, 5.0f, 0.1f);
+    CHECK(output == 0.0f);
+
+    // Measurement rising at 3 per second, the filtered derivative converges to the slope
+    pid.reset();
+    pid.setDerivativeFilter(0.1f);
+    float measurement = 0.0f;
+    for (int idx = 0; idx < 50; idx++) {
+        measurement += 0.3f;
+        output = pid.update(0.0f, measurement, 0.1f);
+    }
+    CHECK(near(pid.getDerivative(), 3.0f, 1e-3f));
+    CHECK(near(output, -6.0f, 1e-2f));
+}
+
+
+// The filter attenuates sample to sample noise in the derivative
+static void test_derivative_filter() {
+    PIDController raw_pid;
+    PIDController filtered_pid;
+    raw_pid.setGains(0.0f, 0.0f, 1.0f);
+    filtered_pid.setGains(0.0f, 0.0f, 1.0f);
+    filtered_pid.setDerivativeFilter(0.3f);
+
+    float raw_peak = 0.0f;
+    float filtered_peak = 0.0f;
+    for (int idx = 0; idx < 100; idx++) {
+        float measurement = (idx % 2) ? 0.02f : -0.02f;
+        raw_peak = fmaxf(raw_peak, fabsf(raw_pid.update(0.0f, measurement, 0.1f)));
+        filtered_peak = fmaxf(filtered_peak, fabsf(filtered_pid.update(0.0f, measurement, 0.1f)));
+    }
+    CHECK(filtered_peak < raw_peak * 0.5f);
+}
+
+
+// Closed loop on an integrating plant limited by the motor speed: the overshoot of a high ki controller
+// stays bounded where the wound up integral would carry far past the setpoint
+static void test_closed_loop_overshoot() {
+    const float setpoint = 20.0f;
+    const float gain = 1.0f;             // Weight per revolution
+    const float dt_s = 0.1f;
+
+    PIDController pid;
+    pid.setGains(0.2f, 0.5f, 0.0f);
+    pid.setOutputLimits(0.0f, 1.0f);
+
+    float weight = 0.0f;
+    float peak_weight = 0.0f;
+    for (int idx = 0; idx < 1000; idx++) {
+        float speed = pid.update(setpoint, weight, dt_s);
+        weight += gain * speed * dt_s;
+        peak_weight = fmaxf(peak_weight, weight);
+    }
+
+    // Reference: the per sample sum with no clamping of the integral
+    float naive_integral = 0.0f;
+    float naive_weight = 0.0f;
+    float naive_peak_weight = 0.0f;
+    for (int idx = 0; idx < 1000; idx++) {
+        float error = setpoint - naive_weight;
+        naive_integral += error * dt_s;
+        float speed = fmaxf(0.0f, fminf(0.2f * error + 0.5f * naive_integral, 1.0f));
+        naive_weight += gain * speed * dt_s;
+        naive_peak_weight = fmaxf(naive_peak_weight, naive_weight);
+    }
+
+    printf("closed loop peak: %.3f, without anti-windup: %.3f, setpoint: %.3f\n",
+           peak_weight, naive_peak_weight, setpoint);
+    CHECK(peak_weight - setpoint < 0.25f * (naive_peak_weight - setpoint));
+}
+
+
+int main() {
+    test_integral_follows_time();
+    test_anti_windup();
+    test_feed_forward_saturation();
+    test_zero_dt();
+    test_non_finite_input();
+    test_derivative_on_measurement();
+    test_derivative_filter();
+    test_closed_loop_overshoot();
+
+    return check_report();
+}
@@ -0,0 +1,311 @@
+/*
+    Checks the RingBuffer and the StatisticRingBuffer on the host: chronological order across the
+    wraparound, dequeue, the running mean, standard deviation, min/max and slope against a direct
+    computation over the same elements, the drift bound of the periodic renormalise, and the recovery
+    of the statistics once a non-finite value leaves the buffer.
+
+    Without --check, also times the enqueue and the statistics against a direct computation over the
+    window, as done before the statistics were kept on the fly.
+
+    Exits non-zero if any check fails.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "RingBuffer.h"
+#include "test_check.h"
+
+
+static bool near(double a, double b, double tolerance) {
+    return fabs(a - b) <= tolerance;
+}
+
+
+// Element without statistics, the plain RingBuffer needs no ring_buffer_value
+typedef struct {
+    uint32_t sequence;
+    float weight;
+} record_t;
+
+
+// Statistics computed directly over the elements
+typedef struct {
+    double mean;
+    double sd;
+    double min;
+    double max;
+    double slope;
+} reference_stat_t;
+
+template <typename Buffer>
+static reference_stat_t reference_stat(const Buffer & buffer) {
+    reference_stat_t stat = {0.0, 0.0, INFINITY, -INFINITY, 0.0};
+    size_t n = buffer.getCounter();
+
+    for (size_t idx = 0; idx < n; idx++) {
+        stat.mean += buffer[idx];
+        stat.min = fmin(stat.min, buffer[idx]);
+        stat.max = fmax(stat.max, buffer[idx]);
+    }
+    stat.mean /= n;
+
+    double sxy = 0.0, sxx = 0.0;
+    for (size_t idx = 0; idx < n; idx++) {
+        double dx = idx - (n - 1) / 2.0;
+        double dy = buffer[idx] - stat.mean;
+        stat.sd += dy * dy;
+        sxy += dx * dy;
+        sxx += dx * dx;
+    }
+    stat.sd = sqrt(stat.sd / n);
+    stat.slope = sxx > 0 ? sxy / sxx : 0.0;
+
+    return stat;
+}
+
+
+template <typename Buffer>
+static void check_stat(const Buffer & buffer, double tolerance) {
+    reference_stat_t stat = reference_stat(buffer);
+
+    CHECK(near(buffer.getMean(), stat.mean, tolerance));
+    CHECK(near(buffer.getSd(), stat.sd, tolerance));
+    CHECK(buffer.getMin() == (float) stat.min);
+    CHECK(buffer.getMax() == (float) stat.max);
+    CHECK(near(buffer.getSlope(), stat.slope, tolerance));
+}
+
+
+// Elements stay in chronological order across the wraparound, the oldest are overwritten
+static void test_wraparound() {
+    RingBuffer<record_t, 5> buffer;
+
+    CHECK(buffer.getCounter() == 0);
+    CHECK(!(buffer.begin() != buffer.end()));
+
+    for (uint32_t sequence = 0; sequence < 13; sequence++) {
+        buffer.enqueue({sequence, sequence * 0.5f});
+
+        size_t expected_cnt = sequence < 5 ? sequence + 1 : 5;
+        CHECK(buffer.getCounter() == expected_cnt);
+        CHECK(buffer.isFull() == (expected_cnt == 5));
+        CHECK(buffer.getOverFlow() == (sequence >= 5));
+        CHECK(buffer.last().sequence == sequence);
+        CHECK(buffer.first().sequence == sequence + 1 - expected_cnt);
+
+        for (size_t idx = 0; idx < buffer.getCounter(); idx++) {
+            CHECK(buffer[idx].sequence == buffer.first().sequence + idx);
+        }
+    }
+
+    uint32_t expected_sequence = 8;
+    for (const record_t & record : buffer) {
+        CHECK(record.sequence == expected_sequence++);
+    }
+    CHECK(expected_sequence == 13);
+
+    // Dequeue from the oldest, an empty buffer is left as is
+    CHECK(buffer.dequeue().sequence == 8);
+    CHECK(buffer.getCounter() == 4);
+    CHECK(buffer.first().sequence == 9);
+    while (buffer.getCounter()) {
+        buffer.dequeue();
+    }
+    buffer.dequeue();
+    CHECK(buffer.getCounter() == 0);
+
+    buffer.enqueue({100, 0.0f});
+    CHECK(buffer.getCounter() == 1);
+    CHECK(buffer.first().sequence == 100 && buffer.last().sequence == 100);
+
+    buffer.reset();
+    CHECK(buffer.getCounter() == 0);
+    CHECK(!buffer.getOverFlow());
+}
+
+
+// The running statistics match a direct computation while filling, across the wraparound and after dequeue
+static void test_statistics() {
+    StatisticRingBuffer<float, 16> buffer;
+
+    CHECK(buffer.getMean() == 0.0f);
+    CHECK(buffer.getSd() == 0.0f);
+    CHECK(buffer.getSlope() == 0.0f);
+
+    for (int idx = 0; idx < 40; idx++) {
+        buffer.enqueue(10.0f + 0.25f * idx + ((idx * 7) % 5) * 0.1f);
+        check_stat(buffer, 1e-4);
+    }
+
+    // A linear ramp has the slope of the ramp and no residual
+    buffer.reset();
+    for (int idx = 0; idx < 30; idx++) {
+        buffer.enqueue(3.0f - 0.5f * idx);
+    }
+    CHECK(near(buffer.getSlope(), -0.5, 1e-5));
+    CHECK(near(buffer.getMean(), 3.0 - 0.5 * 21.5, 1e-4));
+
+    // The min and the max follow the elements that leave the buffer
+    buffer.reset();
+    const float values[] = {5.0f, 1.0f, 9.0f, 4.0f, 6.0f};
+    for (float value : values) {
+        buffer.enqueue(value);
+    }
+    buffer.dequeue();
+    buffer.dequeue();
+    CHECK(buffer.getMin() == 4.0f);
+    CHECK(buffer.getMax() == 9.0f);
+    buffer.dequeue();
+    CHECK(buffer.getMax() == 6.0f);
+    check_stat(buffer, 1e-5);
+
+    // A constant signal has no deviation, rounding never makes the variance negative
+    buffer.reset();
+    for (int idx = 0; idx < 100; idx++) {
+        buffer.enqueue(1234.567f);
+        CHECK(buffer.getVariance() >= 0.0f);
+    }
+    CHECK(buffer.getSd() < 1e-2f);
+
+    // Integer elements
+    StatisticRingBuffer<int32_t, 4> int_buffer;
+    const int32_t int_values[] = {1000, 3000, 2000, 7000, 5000};
+    for (int32_t value : int_values) {
+        int_buffer.enqueue(value);
+    }
+    CHECK(int_buffer.getMean() == 4250.0f);
+    CHECK(int_buffer.getMin() == 2000.0f);
+    CHECK(int_buffer.getMax() == 7000.0f);
+}
+
+
+// Large values with a small spread: the sums drift without the renormalise every RING_BUFFER_RENORMALISE_INTERVAL enqueues
+static void test_renormalise() {
+    StatisticRingBuffer<float, 20> buffer;
+
+    for (int idx = 0; idx < 100000; idx++) {
+        buffer.enqueue(100000.0f + ((idx * 37) % 11) * 0.01f);
+
+        // Right after a renormalise the sums are exact
+        if (idx % RING_BUFFER_RENORMALISE_INTERVAL == RING_BUFFER_RENORMALISE_INTERVAL - 1) {
+            reference_stat_t stat = reference_stat(buffer);
+            CHECK(near(buffer.getSum(), stat.mean * buffer.getCounter(), 1e-6));
+        }
+    }
+
+    // The float mean resolves 0.008 at this magnitude, the deviation is taken from the double sums
+    reference_stat_t stat = reference_stat(buffer);
+    CHECK(near(buffer.getMean(), stat.mean, 1e-2));
+    CHECK(near(buffer.getSd(), stat.sd, 1e-3));
+    CHECK(near(buffer.getSlope(), stat.slope, 1e-4));
+}
+
+
+// A non-finite value poisons the statistics only while it is in the buffer
+static void test_non_finite() {
+    const float non_finite_values[] = {NAN, INFINITY, -INFINITY};
+
+    for (float non_finite : non_finite_values) {
+        StatisticRingBuffer<float, 8> buffer;
+
+        for (int idx = 0; idx < 5; idx++) {
+            buffer.enqueue(1.0f + idx);
+        }
+        buffer.enqueue(non_finite);
+        CHECK(!isfinite(buffer.getMean()));
+
+        // Enqueue until the value is overwritten
+        for (int idx = 0; idx < 8; idx++) {
+            buffer.enqueue(2.0f + 0.1f * idx);
+        }
+        CHECK(isfinite(buffer.getMean()));
+        CHECK(isfinite(buffer.getSlope()));
+        check_stat(buffer, 1e-5);
+
+        // Dequeue
+        buffer.enqueue(non_finite);
+        while (buffer.getCounter() > 1) {
+            buffer.dequeue();
+        }
+        CHECK(!isfinite(buffer.getMean()));
+        buffer.dequeue();
+        buffer.enqueue(3.0f);
+        CHECK(buffer.getMean() == 3.0f);
+        CHECK(buffer.getSd() == 0.0f);
+    }
+}
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static volatile float sink;
+
+
+// Enqueue then read the mean and the standard deviation, as the settle detector does on every sample
+template <size_t N>
+static void bench_window() {
+    const int sample_cnt = 1000000;
+    RingBuffer<float, N> plain;
+    StatisticRingBuffer<float, N> statistic;
+
+    uint64_t start_ns = now_ns();
+    for (int idx = 0; idx < sample_cnt; idx++) {
+        plain.enqueue(idx * 1e-3f);
+        sink = plain.last();
+    }
+    double plain_ns = (double) (now_ns() - start_ns) / sample_cnt;
+
+    start_ns = now_ns();
+    for (int idx = 0; idx < sample_cnt; idx++) {
+        plain.enqueue(idx * 1e-3f);
+
+        float mean = 0.0f;
+        for (float value : plain) {
+            mean += value;
+        }
+        mean /= plain.getCounter();
+
+        float variance = 0.0f;
+        for (float value : plain) {
+            variance += (value - mean) * (value - mean);
+        }
+        sink = mean + sqrtf(variance / plain.getCounter());
+    }
+    double direct_ns = (double) (now_ns() - start_ns) / sample_cnt;
+
+    start_ns = now_ns();
+    for (int idx = 0; idx < sample_cnt; idx++) {
+        statistic.enqueue(idx * 1e-3f);
+        sink = statistic.getMean() + statistic.getSd();
+    }
+    double statistic_ns = (double) (now_ns() - start_ns) / sample_cnt;
+
+    printf("N=%-4zu plain %6.2f ns, direct mean/sd %7.2f ns, running mean/sd %6.2f ns, speedup %.1fx\n",
+           N, plain_ns, direct_ns, statistic_ns, direct_ns / statistic_ns);
+}
+
+
+int main(int argc, char * argv[]) {
+    bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+
+    test_wraparound();
+    test_statistics();
+    test_renormalise();
+    test_non_finite();
+
+    if (!check_only) {
+        bench_window<10>();
+        bench_window<50>();
+        bench_window<200>();
+    }
+
+    return check_report();
+}
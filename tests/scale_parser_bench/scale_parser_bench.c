@@ -0,0 +1,317 @@
+/*
+    Checks scale_parse_decimal() against the frames of every supported scale in corpus/, then fuzzes it
+    with mutations of the same frames and compares the result with a strtod() reference. Without
+    --check it also reports the time per frame of the fixed point parser against strtof().
+
+    The host has an FPU and a fast libc, the RP2040 does not. On the controller strtof() runs in
+    soft-float with the newlib locale handling and the gap is wider than measured here.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+#include "scale_parser.h"
+
+
+#define MAX_FRAME_CNT       128
+#define MAX_FRAME_LEN       64
+#define FUZZ_ITERATIONS     500000
+#define BENCH_ROUNDS        20000
+
+
+typedef struct {
+    char source[32];
+    char frame[MAX_FRAME_LEN];
+    size_t len;
+    bool expect_number;
+    double expected;
+} corpus_frame_t;
+
+
+static const char * corpus_files[] = {
+    "and_fxi.txt",
+    "creedmoor.txt",
+    "generic.txt",
+    "gng_jjb.txt",
+    "jm_science.txt",
+    "radwag_ps_r2.txt",
+    "sartorius.txt",
+    "steinberg_sbs.txt",
+    "ussolid_jfdbs.txt",
+};
+
+static corpus_frame_t corpus[MAX_FRAME_CNT];
+static size_t corpus_cnt = 0;
+static volatile float sink;
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+// Each line is "expected|frame", expected is nan if the frame carries no number. # starts a comment.
+static bool load_corpus(void) {
+    for (size_t file_idx = 0; file_idx < sizeof(corpus_files) / sizeof(corpus_files[0]); file_idx++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", CORPUS_DIR, corpus_files[file_idx]);
+
+        FILE * file = fopen(path, "r");
+        if (file == NULL) {
+            printf("Unable to open %s\n", path);
+            return false;
+        }
+
+        char line[MAX_FRAME_LEN + 32];
+        while (fgets(line, sizeof(line), file) && corpus_cnt < MAX_FRAME_CNT) {
+            line[strcspn(line, "\r\n")] = '\0';
+
+            char * separator = strchr(line, '|');
+            if (line[0] == '#' || separator == NULL) {
+                continue;
+            }
+            *separator = '\0';
+
+            // Frames are sent with the CR LF terminator
+            corpus_frame_t * entry = &corpus[corpus_cnt++];
+            snprintf(entry->source, sizeof(entry->source), "%s", corpus_files[file_idx]);
+            entry->len = snprintf(entry->frame, sizeof(entry->frame), "%s\r\n", separator + 1);
+            entry->expect_number = strcmp(line, "nan") != 0;
+            entry->expected = entry->expect_number ? strtod(line, NULL) : NAN;
+        }
+
+        fclose(file);
+    }
+
+    return corpus_cnt > 0;
+}
+
+
+/*
+    Reference: the same grammar, with the value from strtod(). Returns the number of characters
+    consumed, 0 if there is no number or it has too many significant digits.
+*/
+static size_t reference_parse(const char * str, size_t len, double * value) {
+    char token[MAX_FRAME_LEN + 2];
+    size_t token_len = 0;
+    size_t idx = 0;
+
+    while (idx < len && str[idx] == ' ') {
+        idx++;
+    }
+    if (idx < len && (str[idx] == '+' || str[idx] == '-')) {
+        token[token_len++] = str[idx++];
+        while (idx < len && str[idx] == ' ') {
+            idx++;
+        }
+    }
+
+    bool has_digit = false;
+    bool has_point = false;
+    int significant_digit_cnt = 0;
+    int decimal_cnt = 0;
+    bool leading_zero = true;
+    for (; idx < len; idx++) {
+        if (str[idx] >= '0' && str[idx] <= '9') {
+            has_digit = true;
+            if (str[idx] != '0') {
+                leading_zero = false;
+            }
+            if (!leading_zero) {
+                significant_digit_cnt++;
+            }
+            if (has_point) {
+                decimal_cnt++;
+            }
+        }
+        else if (str[idx] == '.' && !has_point) {
+            has_point = true;
+        }
+        else {
+            break;
+        }
+        token[token_len++] = str[idx];
+    }
+    token[token_len] = '\0';
+
+    if (!has_digit || significant_digit_cnt > SCALE_DECIMAL_MAX_DIGIT_CNT || decimal_cnt > SCALE_DECIMAL_MAX_DIGIT_CNT) {
+        return 0;
+    }
+
+    *value = strtod(token, NULL);
+    return idx;
+}
+
+
+// Compare the parser with the reference on a field of exactly len bytes. Returns false on a mismatch.
+static bool check_field(const char * field, size_t len) {
+    // A copy of the exact length lets the sanitizers catch any read past the field
+    char * copy = malloc(len ? len : 1);
+    memcpy(copy, field, len);
+
+    scale_decimal_t decimal;
+    size_t consumed = scale_parse_decimal(copy, len, &decimal);
+
+    double reference;
+    size_t reference_consumed = reference_parse(copy, len, &reference);
+
+    bool is_ok = consumed == reference_consumed;
+    if (is_ok && consumed) {
+        // The mantissa and the power of ten are exact below 2^24, the division is then correctly rounded
+        float value = scale_decimal_to_float(&decimal);
+        float reference_value = (float) reference;
+        if (abs(decimal.mantissa) < (1 << 24)) {
+            is_ok = value == reference_value;
+        }
+        else {
+            is_ok = fabsf(value - reference_value) <= fabsf(reference_value) * 2 * FLT_EPSILON;
+        }
+    }
+
+    if (!is_ok) {
+        printf("  mismatch on \"%.*s\": consumed %zu, reference %zu\n", (int) len, copy, consumed, reference_consumed);
+    }
+
+    free(copy);
+    return is_ok;
+}
+
+
+static uint32_t check_corpus(void) {
+    uint32_t fail_cnt = 0;
+
+    for (size_t idx = 0; idx < corpus_cnt; idx++) {
+        const corpus_frame_t * entry = &corpus[idx];
+
+        size_t start = scale_skip_to_decimal(entry->frame, entry->len);
+        float weight = scale_parse_weight(entry->frame + start, entry->len - start);
+
+        bool is_ok = entry->expect_number ? fabs(weight - entry->expected) <= fabs(entry->expected) * 1e-6 : isnan(weight);
+        if (!is_ok) {
+            printf("%s: \"%s\" parsed as %f, expected %f\n", entry->source, entry->frame, weight, entry->expected);
+            fail_cnt++;
+        }
+
+        if (!check_field(entry->frame + start, entry->len - start)) {
+            fail_cnt++;
+        }
+    }
+
+    return fail_cnt;
+}
+
+
+// Mutate corpus frames: replace, insert or delete characters, and truncate
+static uint32_t fuzz(void) {
+    static const char alphabet[] = " +-.0123456789eE~?,GNgr\r\n";
+    uint32_t fail_cnt = 0;
+    srand(1);
+
+    for (uint32_t iteration = 0; iteration < FUZZ_ITERATIONS; iteration++) {
+        const corpus_frame_t * entry = &corpus[rand() % corpus_cnt];
+
+        char frame[MAX_FRAME_LEN * 2];
+        size_t len = entry->len;
+        memcpy(frame, entry->frame, len);
+
+        int mutation_cnt = 1 + rand() % 4;
+        for (int mutation = 0; mutation < mutation_cnt; mutation++) {
+            size_t pos = len ? rand() % len : 0;
+            char ch = (rand() % 8) ? alphabet[rand() % (sizeof(alphabet) - 1)] : (char) (rand() % 256);
+
+            switch (rand() % 4) {
+                case 0:
+                    if (len) {
+                        frame[pos] = ch;
+                    }
+                    break;
+                case 1:
+                    if (len < MAX_FRAME_LEN) {
+                        memmove(frame + pos + 1, frame + pos, len - pos);
+                        frame[pos] = ch;
+                        len++;
+                    }
+                    break;
+                case 2:
+                    if (len) {
+                        memmove(frame + pos, frame + pos + 1, len - pos - 1);
+                        len--;
+                    }
+                    break;
+                default:
+                    len = pos;
+                    break;
+            }
+        }
+
+        size_t start = scale_skip_to_decimal(frame, len);
+        if (start > len || !check_field(frame + start, len - start)) {
+            fail_cnt++;
+        }
+    }
+
+    return fail_cnt;
+}
+
+
+static void bench(void) {
+    char terminated_frames[MAX_FRAME_CNT][MAX_FRAME_LEN];
+    size_t starts[MAX_FRAME_CNT];
+    for (size_t idx = 0; idx < corpus_cnt; idx++) {
+        memcpy(terminated_frames[idx], corpus[idx].frame, corpus[idx].len + 1);
+        starts[idx] = scale_skip_to_decimal(corpus[idx].frame, corpus[idx].len);
+    }
+
+    uint64_t frame_cnt = (uint64_t) BENCH_ROUNDS * corpus_cnt;
+    float acc = 0;
+
+    uint64_t start_ns = now_ns();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+        for (size_t idx = 0; idx < corpus_cnt; idx++) {
+            acc += strtof(terminated_frames[idx] + starts[idx], NULL);
+        }
+    }
+    double strtof_ns = (double) (now_ns() - start_ns) / frame_cnt;
+
+    start_ns = now_ns();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+        for (size_t idx = 0; idx < corpus_cnt; idx++) {
+            acc += scale_parse_weight(corpus[idx].frame + starts[idx], corpus[idx].len - starts[idx]);
+        }
+    }
+    double fixed_ns = (double) (now_ns() - start_ns) / frame_cnt;
+
+    sink = acc;
+
+    printf("%zu frames: strtof %6.2f ns, fixed point %6.2f ns, speedup %.2fx\n",
+           corpus_cnt, strtof_ns, fixed_ns, strtof_ns / fixed_ns);
+}
+
+
+int main(int argc, char * argv[]) {
+    bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+
+    if (!load_corpus()) {
+        return 1;
+    }
+
+    uint32_t corpus_fail_cnt = check_corpus();
+    printf("corpus: %zu frames, %u failed\n", corpus_cnt, corpus_fail_cnt);
+
+    uint32_t fuzz_fail_cnt = fuzz();
+    printf("fuzz: %u mutations, %u failed\n", FUZZ_ITERATIONS, fuzz_fail_cnt);
+
+    if (!check_only) {
+        bench();
+    }
+
+    return (corpus_fail_cnt || fuzz_fail_cnt) ? 1 : 0;
+}
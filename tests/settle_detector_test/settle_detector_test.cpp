@@ -0,0 +1,138 @@
+/*
+    Checks the SettleDetector used by the charge mode on the host: a quiet reading settles within a few
+    samples, noise near the margin and a slow creep do not, and a step or an unstable frame from the
+    scale restarts the window.
+
+    Exits non-zero if any check fails.
+*/
+#include <stdio.h>
+#include <math.h>
+#include <random>
+
+#include "SettleDetector.h"
+#include "test_check.h"
+
+
+static const float margin = 0.02f;
+static const uint64_t sample_period_us = 100000;     // 10 Hz
+
+
+// Feed samples until stable, returns the number of samples taken or 0 if it never settles
+template <size_t N, typename F>
+static int samples_to_stable(SettleDetector<N> & detector, int max_sample_cnt, F weight_at) {
+    for (int idx = 0; idx < max_sample_cnt; idx++) {
+        if (detector.update(weight_at(idx), idx * sample_period_us, true)) {
+            return idx + 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// A constant reading settles at the minimum sample count, fewer once the scale has flagged a motion
+static void test_quiet_reading() {
+    SettleDetector<16> detector(margin);
+    int sample_cnt = samples_to_stable(detector, 50, [](int) { return 0.0f; });
+    CHECK(sample_cnt == SETTLE_DETECTOR_MIN_SAMPLE_CNT);
+    CHECK(fabsf(detector.getMean()) < 1e-6f);
+
+    SettleDetector<16> flagged_detector(margin);
+    flagged_detector.update(5.0f, 0, false);
+    sample_cnt = samples_to_stable(flagged_detector, 50, [](int) { return 0.0f; });
+    CHECK(sample_cnt == SETTLE_DETECTOR_MIN_FLAGGED_SAMPLE_CNT);
+}
+
+
+// Noise well below the margin settles within a second, noise at the margin seldom does
+static void test_noise() {
+    std::mt19937 rng(1);
+    std::normal_distribution<float> unit_normal;
+
+    for (int trial = 0; trial < 20; trial++) {
+        SettleDetector<16> detector(margin);
+        int sample_cnt = samples_to_stable(detector, 100, [&](int) { return 0.004f * unit_normal(rng); });
+        CHECK(sample_cnt > 0 && sample_cnt <= 10);
+    }
+
+    // The confidence bound is checked after every sample, so a run at the margin can still pass now and then
+    int settled_cnt = 0;
+    for (int trial = 0; trial < 40; trial++) {
+        SettleDetector<16> detector(margin);
+        if (samples_to_stable(detector, 16, [&](int) { return margin * unit_normal(rng); })) {
+            settled_cnt++;
+        }
+    }
+    printf("noise at the margin settled in %d of 40 trials\n", settled_cnt);
+    CHECK(settled_cnt <= 10);
+
+    for (int trial = 0; trial < 20; trial++) {
+        SettleDetector<16> detector(margin);
+        CHECK(samples_to_stable(detector, 100, [&](int) { return 2 * margin * unit_normal(rng); }) == 0);
+    }
+}
+
+
+// A creep with a small spread fails the slope test
+static void test_creep() {
+    SettleDetector<16> detector(margin);
+    int sample_cnt = samples_to_stable(detector, 100, [](int idx) { return 0.01f * idx; });
+    CHECK(sample_cnt == 0);
+    CHECK(fabsf(detector.getSlope() - 0.1f) < 1e-3f);
+}
+
+
+// A step restarts the window, the mean follows the new load only
+static void test_step() {
+    SettleDetector<16> detector(margin);
+    samples_to_stable(detector, 50, [](int) { return 0.0f; });
+    CHECK(detector.isStable());
+
+    CHECK(!detector.update(-30.0f, 100 * sample_period_us, true));
+    CHECK(detector.getCounter() == 1);
+
+    int sample_cnt = 1;
+    while (!detector.update(-30.0f, (100 + sample_cnt) * sample_period_us, true)) {
+        sample_cnt++;
+    }
+    CHECK(sample_cnt + 1 == SETTLE_DETECTOR_MIN_SAMPLE_CNT);
+    CHECK(fabsf(detector.getMean() + 30.0f) < 1e-4f);
+}
+
+
+// Frames flagged as unstable are never stable and restart the window
+static void test_scale_flag() {
+    SettleDetector<16> detector(margin);
+    for (int idx = 0; idx < 20; idx++) {
+        CHECK(!detector.update(0.0f, idx * sample_period_us, false));
+    }
+    CHECK(detector.getCounter() == 0);
+
+    for (int idx = 20; idx < 22; idx++) {
+        CHECK(!detector.update(0.0f, idx * sample_period_us, true));
+    }
+    CHECK(detector.update(0.0f, 22 * sample_period_us, true));
+}
+
+
+// Samples with the same timestamp do not break the slope
+static void test_same_timestamp() {
+    SettleDetector<16> detector(margin);
+    for (int idx = 0; idx < 10; idx++) {
+        detector.update(0.0f, 0, true);
+    }
+    CHECK(detector.getSlope() == 0.0f);
+    CHECK(detector.isStable());
+}
+
+
+int main() {
+    test_quiet_reading();
+    test_noise();
+    test_creep();
+    test_step();
+    test_scale_flag();
+    test_same_timestamp();
+
+    return check_report();
+}
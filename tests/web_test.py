@@ -75,7 +75,7 @@ def rest_scale_config():
 
 @app.route('/rest/profile_config')
 def rest_profile_config():
-    return {"pf":1,"p0":0,"p1":0,"p2":"AR2209,gr","p3":0.025,"p4":0.000,"p5":0.300,"p6":0.100,"p7":5.000,"p8":2.000,"p9":0.000,"p10":10.000,"p11":0.080,"p12":5.000}
+    return {"pf":1,"p0":0,"p1":0,"p2":"AR2209,gr","p3":0.025,"p4":0.000,"p5":0.300,"p6":0.100,"p7":5.000,"p8":2.000,"p9":0.000,"p10":10.000,"p11":0.080,"p12":5.000,"p13":0.000,"p14":0.000}
 
 
 @app.route('/rest/charge_mode_config')
@@ -95,12 +95,12 @@ def rest_wireless_config():
 
 @app.route('/rest/coarse_motor_config')
 def rest_coarse_motor_config():
-    return {"m0":50.000,"m1":200,"m2":800,"m3":256,"m4":5,"m5":110,"m6":0.100,"m7":1.2500000,"m8":False,"m9":False}
+    return {"m0":50.000,"m1":200,"m2":800,"m3":256,"m4":5,"m5":110,"m6":0.100,"m7":1.2500000,"m8":False,"m9":False,"m10":0,"m11":1000.000}
 
 
 @app.route('/rest/fine_motor_config')
 def rest_fine_motor_config():
-    return {"m0":50.000,"m1":200,"m2":800,"m3":256,"m4":5,"m5":110,"m6":0.100,"m7":2.1052630,"m8":False,"m9":False}
+    return {"m0":50.000,"m1":200,"m2":800,"m3":256,"m4":5,"m5":110,"m6":0.100,"m7":2.1052630,"m8":False,"m9":False,"m10":0,"m11":1000.000}
 
 
 @app.route('/rest/neopixel_led_config')